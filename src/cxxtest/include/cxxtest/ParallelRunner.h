@@ -0,0 +1,1572 @@
+#ifndef __cxxtest__ParallelRunner_h__
+#define __cxxtest__ParallelRunner_h__
+
+//
+// ParallelRunner runs the suites of a world in a pool of worker processes,
+// rather than one after another in the test runner's own process. The
+// workers are forked after the world has been set up, and each one runs the
+// suites that it is handed with a listener that records every event, along
+// with anything the tests print to standard output. The parent replays those
+// recordings through the tracker in the order that the suites would have run
+// serially, so its listeners see exactly the events of a serial run.
+//
+// The pool is used when the CXXTEST_WORKERS environment variable is set to a
+// number greater than one. It is only available on POSIX-based systems.
+//
+
+#ifndef _MSC_VER
+
+#define _CXXTEST_HAVE_PARALLEL_RUNNER
+
+#include <cxxtest/TestListener.h>
+#include <cxxtest/TestSuite.h>
+#include <cxxtest/TestTracker.h>
+#include <cxxtest/Signals.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace CxxTest
+{
+    // ----------------------------------------------------------
+    /**
+     * A growable block of bytes that events are written into and read back
+     * from. Like SafeString, it uses malloc/realloc/free so that it is not
+     * tracked by Dereferee. It has no constructor: a zero-filled buffer is
+     * empty, so buffers can be value-initialized or allocated with calloc.
+     */
+    class EventBuffer
+    {
+    public:
+        //~ Methods ..........................................................
+
+        // ----------------------------------------------------------
+        const char* data() const { return _data; }
+        unsigned size() const { return _size; }
+        void clear() { _size = 0; }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Frees the memory held by the buffer and leaves it empty.
+         */
+        void release()
+        {
+            free(_data);
+            _data = 0;
+            _size = _capacity = 0;
+        }
+
+
+        // ----------------------------------------------------------
+        void append(const void* bytes, unsigned count)
+        {
+            if (_size + count > _capacity)
+            {
+                unsigned capacity = _capacity ? _capacity : 256;
+                while (_size + count > capacity)
+                    capacity *= 2;
+
+                char* data = (char*) realloc(_data, capacity);
+                if (!data)
+                {
+                    puts("Out of memory while recording test events.\n");
+                    exit(1);
+                }
+
+                _data = data;
+                _capacity = capacity;
+            }
+
+            memcpy(_data + _size, bytes, count);
+            _size += count;
+        }
+
+
+        // ----------------------------------------------------------
+        void appendInt(int value)
+        {
+            append(&value, sizeof(int));
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Appends a string, including its terminating null character so that
+         * it can be used in place when it is read back. A null pointer is
+         * recorded as a length of -1.
+         */
+        void appendString(const char* str)
+        {
+            if (!str)
+            {
+                appendInt(-1);
+                return;
+            }
+
+            int length = (int) strlen(str);
+            appendInt(length);
+            append(str, length + 1);
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Appends a block of the given size, or a flag showing that the
+         * pointer to it was null.
+         */
+        void appendBlock(const void* block, unsigned size)
+        {
+            appendInt(block != 0);
+
+            if (block)
+                append(block, size);
+        }
+
+
+    private:
+        //~ Instance variables ...............................................
+
+        char* _data;
+        unsigned _size;
+        unsigned _capacity;
+    };
+
+
+    // ----------------------------------------------------------
+    /**
+     * Reads back the values of a single event in the order in which they
+     * were appended to an EventBuffer. Strings and blocks are returned in
+     * place, so they are only valid as long as the buffer is not changed.
+     */
+    class EventReader
+    {
+    public:
+        // ----------------------------------------------------------
+        EventReader(const char* data) : _next(data) {}
+
+
+        // ----------------------------------------------------------
+        int readInt()
+        {
+            int value;
+            memcpy(&value, _next, sizeof(int));
+            _next += sizeof(int);
+            return value;
+        }
+
+
+        // ----------------------------------------------------------
+        const char* readString()
+        {
+            int length = readInt();
+            if (length < 0)
+                return 0;
+
+            const char* str = _next;
+            _next += length + 1;
+            return str;
+        }
+
+
+        // ----------------------------------------------------------
+        const void* readBytes(unsigned size)
+        {
+            const void* bytes = _next;
+            _next += size;
+            return bytes;
+        }
+
+
+        // ----------------------------------------------------------
+        const void* readBlock(unsigned size)
+        {
+            if (!readInt())
+                return 0;
+
+            const void* block = _next;
+            _next += size;
+            return block;
+        }
+
+
+    private:
+        const char* _next;
+    };
+
+
+    // ----------------------------------------------------------
+    class ParallelRunner
+    {
+    public:
+        // ----------------------------------------------------------
+        /**
+         * The function that runs a single suite, which is called in the
+         * workers (and in the parent, if no worker can be started).
+         */
+        typedef void (*SuiteRunner)( SuiteDescription & );
+
+
+        // ----------------------------------------------------------
+        /**
+         * Gets the number of worker processes to run the suites in, from the
+         * CXXTEST_WORKERS environment variable.
+         *
+         * @returns the number of workers, or 1 if the suites should be run
+         *     serially
+         */
+        static unsigned workerCount()
+        {
+            const char* value = getenv( "CXXTEST_WORKERS" );
+            int workers = value ? atoi( value ) : 1;
+
+            return workers > 1 ? (unsigned) workers : 1;
+        }
+
+
+        // ----------------------------------------------------------
+        ParallelRunner( WorldDescription &wd, SuiteRunner runSuite ) :
+            _world( wd ),
+            _runSuite( runSuite ),
+            _suites( 0 ),
+            _numSuites( 0 ),
+            _workers( 0 ),
+            _pollFds( 0 ),
+            _numWorkers( 0 ),
+            _nextAssigned( 0 ),
+            _nextReplayed( 0 ),
+            _stopping( false )
+        {
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Runs the active suites of the world in the given number of workers
+         * and replays their results through the tracker.
+         *
+         * @param workers the number of workers to start
+         * @returns true if the suites were run, or false if no worker could
+         *     be started and the caller should run them serially
+         */
+        bool run( unsigned workers )
+        {
+            if ( !collectSuites() )
+                return false;
+
+            if ( workers > _numSuites )
+                workers = _numSuites;
+
+            _workers = (Worker *) malloc( workers * sizeof(Worker) );
+            _pollFds = (struct pollfd *) malloc(
+                workers * sizeof(struct pollfd) );
+            if ( !_workers || !_pollFds )
+            {
+                free( _workers );
+                free( _pollFds );
+                releaseSuites();
+                return false;
+            }
+
+            _numWorkers = workers;
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+                _workers[i].pid = -1;
+
+            // A worker that dies while it is being handed a suite must not
+            // take the parent down with it.
+            struct sigaction ignore;
+            memset( &ignore, 0, sizeof(ignore) );
+            ignore.sa_handler = SIG_IGN;
+            sigaction( SIGPIPE, &ignore, &_oldPipeAction );
+
+            unsigned started = 0;
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+                if ( startWorker( _workers[i] ) )
+                    ++ started;
+
+            if ( started == 0 )
+            {
+                sigaction( SIGPIPE, &_oldPipeAction, 0 );
+                free( _workers );
+                free( _pollFds );
+                releaseSuites();
+                return false;
+            }
+
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+                assignNextSuite( _workers[i] );
+
+            while ( _nextReplayed < _numSuites )
+            {
+                if ( !waitForResults() )
+                {
+                    // Either every worker has died and none could be
+                    // restarted, or the workers can no longer be polled.
+                    // Once the suites that were handed out have finished
+                    // and been replayed, run the rest here.
+                    finishWorkers();
+                    for ( ; _nextReplayed < _numSuites; ++ _nextReplayed )
+                        _runSuite( *_suites[_nextReplayed].description );
+                }
+            }
+
+            stopWorkers();
+            sigaction( SIGPIPE, &_oldPipeAction, 0 );
+
+            free( _workers );
+            free( _pollFds );
+            releaseSuites();
+            return true;
+        }
+
+
+    private:
+        //~ Event types ......................................................
+
+        enum {
+            EVENT_OUTPUT = 1,
+            EVENT_ENTER_SUITE,
+            EVENT_ENTER_TEST,
+            EVENT_LEAVE_TEST,
+            EVENT_LEAVE_SUITE,
+            EVENT_TRACE,
+            EVENT_WARNING,
+            EVENT_FAILED_TEST,
+            EVENT_FAILED_ASSERT,
+            EVENT_FAILED_ASSERT_EQUALS,
+            EVENT_FAILED_ASSERT_SAME_DATA,
+            EVENT_FAILED_ASSERT_DELTA,
+            EVENT_FAILED_ASSERT_DIFFERS,
+            EVENT_FAILED_ASSERT_LESS_THAN,
+            EVENT_FAILED_ASSERT_LESS_THAN_EQUALS,
+            EVENT_FAILED_ASSERT_PREDICATE,
+            EVENT_FAILED_ASSERT_RELATION,
+            EVENT_FAILED_ASSERT_THROWS,
+            EVENT_FAILED_ASSERT_THROWS_NOT,
+            EVENT_SUITE_INIT_ERROR,
+            EVENT_SUITE_DONE
+        };
+
+
+        //~ Nested types .....................................................
+
+        // ----------------------------------------------------------
+        /**
+         * A suite to be run, and the events that have been received for it.
+         * Each event is an int holding its size, followed by its type and its
+         * values.
+         */
+        struct Suite
+        {
+            SuiteDescription *description;
+            EventBuffer events;
+
+            // The end of the complete events that have been received, and
+            // the end of those that have been replayed.
+            unsigned received;
+            unsigned replayed;
+
+            // Whether every event has been received, and whether the worker
+            // that ran the suite died before sending them all, in which case
+            // status holds its wait status.
+            bool done;
+            bool died;
+            int status;
+
+            // The replay state, used to close the suite if its worker died.
+            bool entered;
+            bool left;
+            const TestDescription *test;
+        };
+
+
+        // ----------------------------------------------------------
+        struct Worker
+        {
+            pid_t pid;
+            int commands;
+            int results;
+            int suite;
+        };
+
+
+        // ----------------------------------------------------------
+        /**
+         * The listener that a worker installs in its tracker. Each event is
+         * sent to the parent as soon as it happens, preceded by anything the
+         * tests have printed to standard output since the last event, so
+         * that the parent can interleave the two as a serial run would.
+         */
+        class WorkerListener : public TestListener
+        {
+        public:
+            // ------------------------------------------------------
+            WorkerListener( int results, int output ) :
+                _results( results ),
+                _output( output ),
+                _event(),
+                _text(),
+                _frames(),
+                _numFrames( 0 )
+            {
+            }
+
+
+            // ------------------------------------------------------
+            virtual ~WorkerListener()
+            {
+                _event.release();
+                _text.release();
+                _frames.release();
+            }
+
+
+            // ------------------------------------------------------
+            void suiteDone()
+            {
+                begin( EVENT_SUITE_DONE );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void enterSuite( const SuiteDescription & )
+            {
+                begin( EVENT_ENTER_SUITE );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void enterTest( const TestDescription &td )
+            {
+                int index = 0;
+                for ( const TestDescription *t = tracker().suite().firstTest();
+                      t && t != &td; t = t->next() )
+                    ++ index;
+
+                begin( EVENT_ENTER_TEST );
+                _event.appendInt( index );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void leaveTest( const TestDescription & )
+            {
+                begin( EVENT_LEAVE_TEST );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void leaveSuite( const SuiteDescription & )
+            {
+                begin( EVENT_LEAVE_SUITE );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void trace( const char *file, unsigned line,
+                        const char *expression )
+            {
+                begin( EVENT_TRACE, file, line );
+                _event.appendString( expression );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void warning( const char *file, unsigned line,
+                          const char *expression )
+            {
+                begin( EVENT_WARNING, file, line );
+                _event.appendString( expression );
+                appendContext();
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedTest( const char *file, unsigned line,
+                             const char *expression )
+            {
+                begin( EVENT_FAILED_TEST, file, line );
+                _event.appendString( expression );
+                appendContext();
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void suiteInitError( const char *file, unsigned line,
+                                 const char *expression )
+            {
+                begin( EVENT_SUITE_INIT_ERROR, file, line );
+                _event.appendString( expression );
+                appendContext();
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssert( const char *file, unsigned line,
+                               const char *expression )
+            {
+                begin( EVENT_FAILED_ASSERT, file, line );
+                _event.appendString( expression );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertEquals( const char *file, unsigned line,
+                                     const char *xStr, const char *yStr,
+                                     const char *x, const char *y )
+            {
+                begin( EVENT_FAILED_ASSERT_EQUALS, file, line );
+                appendStrings( xStr, yStr, x, y );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertSameData( const char *file, unsigned line,
+                                       const char *xStr, const char *yStr,
+                                       const char *sizeStr, const void *x,
+                                       const void *y, unsigned size )
+            {
+                begin( EVENT_FAILED_ASSERT_SAME_DATA, file, line );
+                appendStrings( xStr, yStr, sizeStr );
+                _event.appendInt( (int) size );
+                _event.appendBlock( x, size );
+                _event.appendBlock( y, size );
+
+                // The test may have changed the dump size, which the parent's
+                // listeners read when they print the blocks.
+                _event.appendInt( (int) maxDumpSize() );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertDelta( const char *file, unsigned line,
+                                    const char *xStr, const char *yStr,
+                                    const char *dStr, const char *x,
+                                    const char *y, const char *d )
+            {
+                begin( EVENT_FAILED_ASSERT_DELTA, file, line );
+                appendStrings( xStr, yStr, dStr );
+                appendStrings( x, y, d );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertDiffers( const char *file, unsigned line,
+                                      const char *xStr, const char *yStr,
+                                      const char *value )
+            {
+                begin( EVENT_FAILED_ASSERT_DIFFERS, file, line );
+                appendStrings( xStr, yStr, value );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertLessThan( const char *file, unsigned line,
+                                       const char *xStr, const char *yStr,
+                                       const char *x, const char *y )
+            {
+                begin( EVENT_FAILED_ASSERT_LESS_THAN, file, line );
+                appendStrings( xStr, yStr, x, y );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertLessThanEquals( const char *file, unsigned line,
+                                             const char *xStr,
+                                             const char *yStr,
+                                             const char *x, const char *y )
+            {
+                begin( EVENT_FAILED_ASSERT_LESS_THAN_EQUALS, file, line );
+                appendStrings( xStr, yStr, x, y );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertPredicate( const char *file, unsigned line,
+                                        const char *predicate,
+                                        const char *xStr, const char *x )
+            {
+                begin( EVENT_FAILED_ASSERT_PREDICATE, file, line );
+                appendStrings( predicate, xStr, x );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertRelation( const char *file, unsigned line,
+                                       const char *relation,
+                                       const char *xStr, const char *yStr,
+                                       const char *x, const char *y )
+            {
+                begin( EVENT_FAILED_ASSERT_RELATION, file, line );
+                _event.appendString( relation );
+                appendStrings( xStr, yStr, x, y );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertThrows( const char *file, unsigned line,
+                                     const char *expression,
+                                     const char *type, bool otherThrown )
+            {
+                begin( EVENT_FAILED_ASSERT_THROWS, file, line );
+                appendStrings( expression, type );
+                _event.appendInt( otherThrown );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void failedAssertThrowsNot( const char *file, unsigned line,
+                                        const char *expression )
+            {
+                begin( EVENT_FAILED_ASSERT_THROWS_NOT, file, line );
+                _event.appendString( expression );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            bool visitBacktraceFrame( int index, void* frame,
+                                      const char* function,
+                                      const char* filename,
+                                      int lineNumber )
+            {
+                _frames.appendInt( index );
+                _frames.append( &frame, sizeof(frame) );
+                _frames.appendString( function );
+                _frames.appendString( filename );
+                _frames.appendInt( lineNumber );
+                ++ _numFrames;
+
+                return true;
+            }
+
+
+        private:
+            // ------------------------------------------------------
+            void begin( int type )
+            {
+                sendOutput();
+
+                _event.clear();
+                _event.appendInt( type );
+            }
+
+
+            // ------------------------------------------------------
+            void begin( int type, const char *file, unsigned line )
+            {
+                begin( type );
+                _event.appendString( file );
+                _event.appendInt( (int) line );
+            }
+
+
+            // ------------------------------------------------------
+            void appendStrings( const char *a, const char *b,
+                                const char *c = 0, const char *d = 0 )
+            {
+                _event.appendString( a );
+                _event.appendString( b );
+                _event.appendString( c );
+                _event.appendString( d );
+            }
+
+
+            // ------------------------------------------------------
+            /**
+             * Appends the state that listeners read when they report a
+             * failure: the signal that caused it, and the frames of the
+             * backtrace that they would walk.
+             */
+            void appendContext()
+            {
+#ifdef CXXTEST_TRAP_SIGNALS
+                _event.appendInt( __cxxtest_last_signal );
+#else // !CXXTEST_TRAP_SIGNALS
+                _event.appendInt( 0 );
+#endif // CXXTEST_TRAP_SIGNALS
+
+                _frames.clear();
+                _numFrames = 0;
+                walkLastBacktrace();
+
+                _event.appendInt( _numFrames );
+                _event.append( _frames.data(), _frames.size() );
+            }
+
+
+            // ------------------------------------------------------
+            /**
+             * Sends anything that has been printed to standard output since
+             * the last event, and empties the file that it was written to.
+             */
+            void sendOutput()
+            {
+                if ( _output < 0 )
+                    return;
+
+                fflush( stdout );
+
+                off_t length = lseek( _output, 0, SEEK_CUR );
+                if ( length <= 0 )
+                    return;
+
+                _text.clear();
+                char chunk[BUFSIZ];
+                for ( off_t offset = 0; offset < length; )
+                {
+                    size_t count = sizeof(chunk);
+                    if ( (off_t) count > length - offset )
+                        count = (size_t) ( length - offset );
+
+                    ssize_t n = pread( _output, chunk, count, offset );
+                    if ( n <= 0 )
+                        break;
+
+                    _text.append( chunk, (unsigned) n );
+                    offset += n;
+                }
+
+                if ( ftruncate( _output, 0 ) == 0 )
+                    lseek( _output, 0, SEEK_SET );
+
+                _event.clear();
+                _event.appendInt( EVENT_OUTPUT );
+                _event.appendInt( (int) _text.size() );
+                _event.append( _text.data(), _text.size() );
+                send();
+            }
+
+
+            // ------------------------------------------------------
+            void send()
+            {
+                int size = (int) _event.size();
+
+                if ( !writeAll( _results, &size, sizeof(size) ) ||
+                     !writeAll( _results, _event.data(), _event.size() ) )
+                {
+                    // The parent has gone away, so nobody is listening.
+                    _exit( 1 );
+                }
+            }
+
+
+            //~ Instance variables ...........................................
+
+            int _results;
+            int _output;
+            EventBuffer _event;
+            EventBuffer _text;
+            EventBuffer _frames;
+            int _numFrames;
+        };
+
+
+        // ----------------------------------------------------------
+        /**
+         * Makes the signal and backtrace frames recorded with a failure the
+         * ones that the parent's listeners see while it is replayed, and puts
+         * back the parent's own when it goes out of scope.
+         */
+        class ReplayedContext
+        {
+        public:
+            // ------------------------------------------------------
+            ReplayedContext( EventReader &reader )
+            {
+                int lastSignal = reader.readInt();
+                unsigned count = (unsigned) reader.readInt();
+
+                install( lastSignal, count );
+
+                for ( unsigned i = 0; _frames && i < count; ++ i )
+                {
+                    _frames[i].index = reader.readInt();
+                    memcpy( &_frames[i].frame, reader.readBytes(
+                        sizeof(void*) ), sizeof(void*) );
+                    _frames[i].function = reader.readString();
+                    _frames[i].filename = reader.readString();
+                    _frames[i].lineNumber = reader.readInt();
+                }
+            }
+
+
+            // ------------------------------------------------------
+            /**
+             * Installs a signal with no backtrace, for a failure that the
+             * parent reports itself.
+             */
+            ReplayedContext( int lastSignal )
+            {
+                install( lastSignal, 0 );
+            }
+
+
+            // ------------------------------------------------------
+            ~ReplayedContext()
+            {
+#ifdef CXXTEST_TRAP_SIGNALS
+                __cxxtest_last_signal = _oldSignal;
+#endif // CXXTEST_TRAP_SIGNALS
+
+                __cxxtest_replayed_frames = _oldFrames;
+                __cxxtest_replayed_frame_count = _oldCount;
+                free( _frames );
+            }
+
+
+        private:
+            // ------------------------------------------------------
+            void install( int lastSignal, unsigned count )
+            {
+                _frames = (ReplayedFrame *) malloc(
+                    ( count ? count : 1 ) * sizeof(ReplayedFrame) );
+
+                _oldFrames = __cxxtest_replayed_frames;
+                _oldCount = __cxxtest_replayed_frame_count;
+                __cxxtest_replayed_frames = _frames;
+                __cxxtest_replayed_frame_count = _frames ? count : 0;
+
+#ifdef CXXTEST_TRAP_SIGNALS
+                _oldSignal = __cxxtest_last_signal;
+                __cxxtest_last_signal = lastSignal;
+#else // !CXXTEST_TRAP_SIGNALS
+                (void) lastSignal;
+#endif // CXXTEST_TRAP_SIGNALS
+            }
+
+
+            ReplayedFrame *_frames;
+            const ReplayedFrame *_oldFrames;
+            unsigned _oldCount;
+#ifdef CXXTEST_TRAP_SIGNALS
+            int _oldSignal;
+#endif // CXXTEST_TRAP_SIGNALS
+        };
+
+
+        //~ Parent methods ...................................................
+
+        // ----------------------------------------------------------
+        bool collectSuites()
+        {
+            unsigned count = 0;
+            for ( SuiteDescription *sd = _world.firstSuite(); sd;
+                  sd = sd->next() )
+                if ( sd->active() )
+                    ++ count;
+
+            if ( count == 0 )
+                return false;
+
+            _suites = (Suite *) calloc( count, sizeof(Suite) );
+            if ( !_suites )
+                return false;
+
+            for ( SuiteDescription *sd = _world.firstSuite(); sd;
+                  sd = sd->next() )
+                if ( sd->active() )
+                    _suites[_numSuites++].description = sd;
+
+            return true;
+        }
+
+
+        // ----------------------------------------------------------
+        void releaseSuites()
+        {
+            for ( unsigned i = 0; i < _numSuites; ++ i )
+                _suites[i].events.release();
+
+            free( _suites );
+            _suites = 0;
+        }
+
+
+        // ----------------------------------------------------------
+        bool startWorker( Worker &w )
+        {
+            int commands[2], results[2];
+
+            if ( pipe( commands ) != 0 )
+                return false;
+
+            if ( pipe( results ) != 0 )
+            {
+                close( commands[0] );
+                close( commands[1] );
+                return false;
+            }
+
+            // Anything still buffered would otherwise be written again by the
+            // worker when it flushes its own output.
+            fflush( stdout );
+            fflush( stderr );
+
+            pid_t pid = fork();
+            if ( pid < 0 )
+            {
+                close( commands[0] );
+                close( commands[1] );
+                close( results[0] );
+                close( results[1] );
+                return false;
+            }
+
+            if ( pid == 0 )
+            {
+                close( commands[1] );
+                close( results[0] );
+                runWorker( commands[0], results[1] );
+            }
+
+            close( commands[0] );
+            close( results[1] );
+
+            w.pid = pid;
+            w.commands = commands[1];
+            w.results = results[0];
+            w.suite = -1;
+            return true;
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Hands the next suite that has not been run to an idle worker.
+         */
+        void assignNextSuite( Worker &w )
+        {
+            if ( _stopping || w.pid < 0 || _nextAssigned >= _numSuites )
+                return;
+
+            int index = (int) _nextAssigned;
+            if ( writeAll( w.commands, &index, sizeof(index) ) )
+            {
+                w.suite = index;
+                ++ _nextAssigned;
+            }
+
+            // Otherwise the worker has died; that is noticed when its
+            // results pipe is closed, and the suite is handed to another.
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Waits until a busy worker sends results or dies, handles them, and
+         * replays whatever can now be replayed in order.
+         *
+         * @returns false if there are no workers left to wait for, or if
+         *     they cannot be polled
+         */
+        bool waitForResults()
+        {
+            struct pollfd *fds = _pollFds;
+            nfds_t count = 0;
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+            {
+                if ( _workers[i].pid >= 0 )
+                {
+                    fds[count].fd = _workers[i].results;
+                    fds[count].events = POLLIN;
+                    fds[count].revents = 0;
+                    ++ count;
+                }
+            }
+
+            if ( count == 0 )
+                return false;
+
+            // An interrupted wait is simply tried again; any other failure
+            // would fail the same way every time it was retried.
+            if ( poll( fds, count, -1 ) < 0 )
+                return errno == EINTR;
+
+            for ( nfds_t j = 0; j < count; ++ j )
+            {
+                if ( !fds[j].revents )
+                    continue;
+
+                for ( unsigned i = 0; i < _numWorkers; ++ i )
+                {
+                    if ( _workers[i].pid >= 0 &&
+                         _workers[i].results == fds[j].fd )
+                    {
+                        readResults( _workers[i] );
+                        break;
+                    }
+                }
+            }
+
+            replayInOrder();
+            return true;
+        }
+
+
+        // ----------------------------------------------------------
+        void readResults( Worker &w )
+        {
+            char chunk[BUFSIZ];
+            ssize_t n = read( w.results, chunk, sizeof(chunk) );
+
+            if ( n < 0 && errno == EINTR )
+                return;
+
+            if ( n <= 0 )
+            {
+                workerDied( w );
+                return;
+            }
+
+            if ( w.suite < 0 )
+                return;
+
+            Suite &s = _suites[w.suite];
+            s.events.append( chunk, (unsigned) n );
+
+            // Find the events that are now complete, to tell when the suite
+            // is done and the worker can be handed another one.
+            while ( s.received + sizeof(int) <= s.events.size() )
+            {
+                EventReader reader( s.events.data() + s.received );
+                unsigned size = (unsigned) reader.readInt();
+                if ( s.received + sizeof(int) + size > s.events.size() )
+                    break;
+
+                int type = reader.readInt();
+                s.received += sizeof(int) + size;
+
+                if ( type == EVENT_SUITE_DONE )
+                {
+                    s.done = true;
+                    w.suite = -1;
+                    assignNextSuite( w );
+                    break;
+                }
+            }
+        }
+
+
+        // ----------------------------------------------------------
+        void workerDied( Worker &w )
+        {
+            int status = 0;
+            waitpid( w.pid, &status, 0 );
+
+            close( w.commands );
+            close( w.results );
+            w.pid = -1;
+
+            if ( w.suite >= 0 )
+            {
+                Suite &s = _suites[w.suite];
+                s.done = true;
+                s.died = true;
+                s.status = status;
+                w.suite = -1;
+            }
+
+            if ( !_stopping && _nextAssigned < _numSuites && startWorker( w ) )
+                assignNextSuite( w );
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Lets each worker that is still running finish its current suite,
+         * reading its results without polling, and then replays them. Used
+         * when the workers cannot be polled, so that a suite that has been
+         * handed out is neither lost nor run a second time.
+         */
+        void finishWorkers()
+        {
+            _stopping = true;
+
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+            {
+                Worker &w = _workers[i];
+                if ( w.pid < 0 )
+                    continue;
+
+                // Closing the commands pipe tells the worker to exit once
+                // its current suite is done, which closes its results pipe.
+                close( w.commands );
+                w.commands = -1;
+
+                while ( w.pid >= 0 )
+                    readResults( w );
+            }
+
+            replayInOrder();
+        }
+
+
+        // ----------------------------------------------------------
+        void stopWorkers()
+        {
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+            {
+                Worker &w = _workers[i];
+                if ( w.pid < 0 )
+                    continue;
+
+                // Closing the commands pipe tells the worker to exit.
+                close( w.commands );
+                close( w.results );
+                waitpid( w.pid, 0, 0 );
+                w.pid = -1;
+            }
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Replays the events that have been received for the earliest suites
+         * whose results have not all been replayed yet, stopping at the
+         * first one that is still running.
+         */
+        void replayInOrder()
+        {
+            while ( _nextReplayed < _numSuites )
+            {
+                Suite &s = _suites[_nextReplayed];
+
+                while ( s.replayed < s.received )
+                {
+                    EventReader reader( s.events.data() + s.replayed );
+                    unsigned size = (unsigned) reader.readInt();
+                    replayEvent( s, reader );
+                    s.replayed += sizeof(int) + size;
+                }
+
+                if ( !s.done )
+                    break;
+
+                if ( s.died )
+                    closeDeadSuite( s );
+
+                s.events.release();
+                ++ _nextReplayed;
+            }
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Reports the death of the worker that was running a suite as a
+         * failure of the test that it was in, and closes the suite.
+         */
+        void closeDeadSuite( Suite &s )
+        {
+            if ( s.left )
+                return;
+
+            SuiteDescription &sd = *s.description;
+            if ( !s.entered )
+                tracker().enterSuite( sd );
+
+            char message[80];
+            int lastSignal = 0;
+
+            if ( WIFSIGNALED( s.status ) )
+            {
+                lastSignal = WTERMSIG( s.status );
+                snprintf( message, sizeof(message),
+                          "Test process was killed by signal %d", lastSignal );
+            }
+            else
+            {
+                snprintf( message, sizeof(message),
+                          "Test process exited with status %d",
+                          WEXITSTATUS( s.status ) );
+            }
+
+            ReplayedContext context( lastSignal );
+
+            if ( s.test )
+            {
+                tracker().failedTest( s.test->file(), s.test->line(), message );
+                tracker().leaveTest( *s.test );
+            }
+            else
+            {
+                tracker().failedTest( sd.file(), sd.line(), message );
+            }
+
+            tracker().leaveSuite( sd );
+        }
+
+
+        // ----------------------------------------------------------
+        void replayEvent( Suite &s, EventReader &r )
+        {
+            int type = r.readInt();
+
+            switch ( type )
+            {
+                case EVENT_OUTPUT:
+                {
+                    unsigned size = (unsigned) r.readInt();
+                    fwrite( r.readBytes( size ), 1, size, stdout );
+                    break;
+                }
+
+                case EVENT_ENTER_SUITE:
+                    s.entered = true;
+                    tracker().enterSuite( *s.description );
+                    break;
+
+                case EVENT_ENTER_TEST:
+                {
+                    int index = r.readInt();
+                    const TestDescription *td = s.description->firstTest();
+                    while ( td && index-- > 0 )
+                        td = td->next();
+
+                    s.test = td;
+                    if ( td )
+                        tracker().enterTest( *td );
+                    break;
+                }
+
+                case EVENT_LEAVE_TEST:
+                    if ( s.test )
+                        tracker().leaveTest( *s.test );
+                    s.test = 0;
+                    break;
+
+                case EVENT_LEAVE_SUITE:
+                    s.left = true;
+                    tracker().leaveSuite( *s.description );
+                    break;
+
+                case EVENT_SUITE_DONE:
+                    break;
+
+                default:
+                    replayFailure( type, r );
+                    break;
+            }
+        }
+
+
+        // ----------------------------------------------------------
+        void replayFailure( int type, EventReader &r )
+        {
+            const char *file = r.readString();
+            unsigned line = (unsigned) r.readInt();
+
+            switch ( type )
+            {
+                case EVENT_TRACE:
+                {
+                    const char *expression = r.readString();
+                    tracker().trace( file, line, expression );
+                    break;
+                }
+
+                case EVENT_WARNING:
+                {
+                    const char *expression = r.readString();
+                    ReplayedContext context( r );
+                    tracker().warning( file, line, expression );
+                    break;
+                }
+
+                case EVENT_FAILED_TEST:
+                {
+                    const char *expression = r.readString();
+                    ReplayedContext context( r );
+                    tracker().failedTest( file, line, expression );
+                    break;
+                }
+
+                case EVENT_SUITE_INIT_ERROR:
+                {
+                    const char *expression = r.readString();
+                    ReplayedContext context( r );
+                    tracker().suiteInitError( file, line, expression );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT:
+                {
+                    const char *expression = r.readString();
+                    tracker().failedAssert( file, line, expression );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_EQUALS:
+                {
+                    Strings s( r );
+                    tracker().failedAssertEquals( file, line,
+                        s[0], s[1], s[2], s[3] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_SAME_DATA:
+                {
+                    Strings s( r );
+                    unsigned size = (unsigned) r.readInt();
+                    const void *x = r.readBlock( size );
+                    const void *y = r.readBlock( size );
+
+                    unsigned oldDumpSize = maxDumpSize();
+                    setMaxDumpSize( (unsigned) r.readInt() );
+                    tracker().failedAssertSameData( file, line,
+                        s[0], s[1], s[2], x, y, size );
+                    setMaxDumpSize( oldDumpSize );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_DELTA:
+                {
+                    Strings s( r );
+                    Strings values( r );
+                    tracker().failedAssertDelta( file, line,
+                        s[0], s[1], s[2], values[0], values[1], values[2] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_DIFFERS:
+                {
+                    Strings s( r );
+                    tracker().failedAssertDiffers( file, line,
+                        s[0], s[1], s[2] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_LESS_THAN:
+                {
+                    Strings s( r );
+                    tracker().failedAssertLessThan( file, line,
+                        s[0], s[1], s[2], s[3] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_LESS_THAN_EQUALS:
+                {
+                    Strings s( r );
+                    tracker().failedAssertLessThanEquals( file, line,
+                        s[0], s[1], s[2], s[3] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_PREDICATE:
+                {
+                    Strings s( r );
+                    tracker().failedAssertPredicate( file, line,
+                        s[0], s[1], s[2] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_RELATION:
+                {
+                    const char *relation = r.readString();
+                    Strings s( r );
+                    tracker().failedAssertRelation( file, line,
+                        relation, s[0], s[1], s[2], s[3] );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_THROWS:
+                {
+                    Strings s( r );
+                    bool otherThrown = r.readInt() != 0;
+                    tracker().failedAssertThrows( file, line,
+                        s[0], s[1], otherThrown );
+                    break;
+                }
+
+                case EVENT_FAILED_ASSERT_THROWS_NOT:
+                {
+                    const char *expression = r.readString();
+                    tracker().failedAssertThrowsNot( file, line, expression );
+                    break;
+                }
+            }
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * The strings appended to an event by WorkerListener::appendStrings,
+         * read back in the same order.
+         */
+        class Strings
+        {
+        public:
+            Strings( EventReader &r )
+            {
+                for ( int i = 0; i < 4; ++ i )
+                    _s[i] = r.readString();
+            }
+
+            const char *operator[]( int i ) const { return _s[i]; }
+
+        private:
+            const char *_s[4];
+        };
+
+
+        //~ Worker methods ...................................................
+
+        // ----------------------------------------------------------
+        /**
+         * Runs the suites that the parent hands out, one at a time, until
+         * the commands pipe is closed. Never returns.
+         */
+        void runWorker( int commands, int results )
+        {
+            sigaction( SIGPIPE, &_oldPipeAction, 0 );
+
+            for ( unsigned i = 0; i < _numWorkers; ++ i )
+            {
+                if ( _workers[i].pid >= 0 )
+                {
+                    close( _workers[i].commands );
+                    close( _workers[i].results );
+                }
+            }
+
+            WorkerListener listener( results, redirectOutput() );
+            tracker().setListener( &listener );
+
+            int index;
+            while ( readAll( commands, &index, sizeof(index) ) )
+            {
+                _TS_TRY
+                {
+                    _runSuite( *_suites[index].description );
+                }
+                _TS_LAST_CATCH( {
+                    tracker().failedTest( __FILE__, __LINE__,
+                        "Exception thrown from world" );
+                } );
+
+                listener.suiteDone();
+            }
+
+            // Exit without running static destructors or atexit handlers,
+            // which belong to the parent; Dereferee's report of the blocks
+            // that are still allocated, for one, is made there.
+            _exit( 0 );
+        }
+
+
+        // ----------------------------------------------------------
+        /**
+         * Sends standard output to a temporary file, which the worker's
+         * listener empties as it sends each event.
+         *
+         * @returns a descriptor for the file, or -1 if it could not be
+         *     created and output is left going where it was
+         */
+        static int redirectOutput()
+        {
+            FILE *file = tmpfile();
+            if ( !file )
+                return -1;
+
+            fflush( stdout );
+            if ( dup2( fileno( file ), STDOUT_FILENO ) < 0 )
+            {
+                fclose( file );
+                return -1;
+            }
+
+            return fileno( file );
+        }
+
+
+        //~ Pipe helpers .....................................................
+
+        // ----------------------------------------------------------
+        static bool writeAll( int fd, const void *data, size_t size )
+        {
+            const char *p = (const char *) data;
+
+            while ( size > 0 )
+            {
+                ssize_t n = write( fd, p, size );
+                if ( n < 0 && errno == EINTR )
+                    continue;
+                if ( n <= 0 )
+                    return false;
+
+                p += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        // ----------------------------------------------------------
+        static bool readAll( int fd, void *data, size_t size )
+        {
+            char *p = (char *) data;
+
+            while ( size > 0 )
+            {
+                ssize_t n = read( fd, p, size );
+                if ( n < 0 && errno == EINTR )
+                    continue;
+                if ( n <= 0 )
+                    return false;
+
+                p += n;
+                size -= n;
+            }
+
+            return true;
+        }
+
+
+        //~ Instance variables ...............................................
+
+        WorldDescription &_world;
+        SuiteRunner _runSuite;
+        Suite *_suites;
+        unsigned _numSuites;
+        Worker *_workers;
+        struct pollfd *_pollFds;
+        unsigned _numWorkers;
+        unsigned _nextAssigned;
+        unsigned _nextReplayed;
+        bool _stopping;
+        struct sigaction _oldPipeAction;
+    };
+}
+
+#endif // !_MSC_VER
+
+#endif // __cxxtest__ParallelRunner_h__
@@ -10,6 +10,8 @@ namespace CxxTest
     //
     bool __cxxtest_runCompleted = false;
     void** __cxxtest_sig_backtrace = NULL;
+    const ReplayedFrame* __cxxtest_replayed_frames = NULL;
+    unsigned __cxxtest_replayed_frame_count = 0;
 
 
     //
@@ -19,6 +19,24 @@ namespace CxxTest
     extern void**       __cxxtest_sig_backtrace;
     extern SafeString   __cxxtest_sigmsg;
     extern SafeString   __cxxtest_assertmsg;
+
+    //
+    // A backtrace frame recorded by a worker process of the ParallelRunner.
+    // While the parent replays a failure, __cxxtest_replayed_frames points
+    // to the frames recorded with it, and listeners walk those instead of
+    // the parent's own stack.
+    //
+    struct ReplayedFrame
+    {
+        int         index;
+        void*       frame;
+        const char* function;
+        const char* filename;
+        int         lineNumber;
+    };
+
+    extern const ReplayedFrame* __cxxtest_replayed_frames;
+    extern unsigned             __cxxtest_replayed_frame_count;
 }
 
 
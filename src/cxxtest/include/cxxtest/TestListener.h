@@ -80,6 +80,21 @@ namespace CxxTest
         virtual void walkLastBacktrace()
         {
 #ifdef CXXTEST_TRACE_STACK
+            const ReplayedFrame* frames = CxxTest::__cxxtest_replayed_frames;
+
+            if (frames)
+            {
+                for (unsigned i = 0; i < __cxxtest_replayed_frame_count; i++)
+                {
+                    if (!visitBacktraceFrame(frames[i].index, frames[i].frame,
+                        frames[i].function, frames[i].filename,
+                        frames[i].lineNumber))
+                        break;
+                }
+
+                return;
+            }
+
             Dereferee::platform* platform = Dereferee::current_platform();
             void **bt = CxxTest::__cxxtest_sig_backtrace;
             bool btNeedsFree = false;
@@ -12,6 +12,7 @@
 #include <cxxtest/TestSuite.h>
 #include <cxxtest/TestTracker.h>
 #include <cxxtest/SuiteInitFailureTable.h>
+#include <cxxtest/ParallelRunner.h>
 
 namespace CxxTest 
 {
@@ -53,15 +54,37 @@ namespace CxxTest
             
             tracker().enterWorld( wd );
             if ( wd.setUp() ) {
-                for ( SuiteDescription *sd = wd.firstSuite(); sd; sd = sd->next() )
-                    if ( sd->active() )
-                        runSuite( *sd );
+                if ( !runSuitesInWorkers( wd ) )
+                    for ( SuiteDescription *sd = wd.firstSuite(); sd; sd = sd->next() )
+                        if ( sd->active() )
+                            runSuite( *sd );
             
                 wd.tearDown();
             }
             tracker().leaveWorld( wd );
         }
     
+        //
+        // Runs the suites in a pool of worker processes if CXXTEST_WORKERS
+        // asks for more than one. Returns false if they should be run here.
+        //
+        bool runSuitesInWorkers( WorldDescription &wd )
+        {
+#ifdef _CXXTEST_HAVE_PARALLEL_RUNNER
+            unsigned workers = ParallelRunner::workerCount();
+
+            if ( workers > 1 )
+                return ParallelRunner( wd, runSuiteInWorker ).run( workers );
+#endif // _CXXTEST_HAVE_PARALLEL_RUNNER
+
+            return false;
+        }
+
+        static void runSuiteInWorker( SuiteDescription &sd )
+        {
+            TestRunner().runSuite( sd );
+        }
+    
         void runSuite( SuiteDescription &sd )
         {
             StateGuard sg;
@@ -106,6 +106,7 @@ namespace CxxTest
         void countFailure();
 
         friend class TestRunner;
+        friend class ParallelRunner;
         
         TestTracker();
         void initialize();
@@ -55,6 +55,11 @@
  * nullifying a macro definition. Instead, if DEREFEREE_DISABLED is defined in
  * this case, the checked_ptr<> class is replaced by a lightweight wrapper
  * class that contains no extra behavior.
+ *
+ * Between these extremes, DEREFEREE_CHECK_LEVEL selects which checks
+ * checked(T*) performs for a whole program, and a single pointer can be given
+ * its own level by declaring it as checked_ptr<T*, Dereferee::check_level<N> >
+ * (see dereferee/check_level.h for the levels).
  */
 
 #ifdef DEREFEREE_CONFIG_ENHANCED_DECLARATION
@@ -119,6 +124,26 @@ Dereferee::listener* Dereferee::current_listener();
 void Dereferee::visit_allocations(Dereferee::allocation_visitor visitor,
                                   void* arg);
 
+// ---------------------------------------------------------------------------
+/**
+ * Public interface that can be used by clients to visit the currently
+ * allocated blocks of memory that Dereferee is managing, in order of address,
+ * until the visitor asks to stop. The visitor is called while the memory
+ * manager's table is locked, so it must not allocate or free memory with new
+ * or delete.
+ *
+ * @param visitor the visitor function that will be called for each allocated
+ *     block of memory; the signature of this function is
+ *     bool allocation_visitor(const Dereferee::allocation_info& info,
+ *                             void* arg)
+ *     and it returns false to stop visiting blocks
+ * @param arg a user-defined argument that is passed to the visitor
+ * @returns true if every block was visited, or false if the visitor stopped
+ *     early
+ */
+bool Dereferee::visit_allocations_while(
+    Dereferee::allocation_visitor_while visitor, void* arg);
+
 // ===========================================================================
 /*
  * Import only the declaration of checked_ptr into the global namespace. No
@@ -54,13 +54,13 @@ size_t allocation_info_impl::array_size() const
 // ---------------------------------------------------------------------------
 const char* allocation_info_impl::type_name() const
 {
-	return info->type_name;
+	return interned_type_name(info->type_name);
 }
 
 // ---------------------------------------------------------------------------
 void** allocation_info_impl::backtrace() const
 {
-	return info->backtrace;
+	return interned_backtrace(info->backtrace);
 }
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,526 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_ARENA_H
+#define DEREFEREE_ARENA_H
+
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <dereferee/threads.h>
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/**
+ * The number of bytes requested from the system each time a slab allocator
+ * runs out of free objects.
+ */
+#define DEREFEREE_ARENA_SLAB_SIZE 16384
+
+/**
+ * The alignment of every object handed out by a slab allocator.
+ */
+#define DEREFEREE_ARENA_ALIGNMENT 16
+
+
+// ===========================================================================
+/**
+ * A free-list allocator for fixed-size objects that are used internally by
+ * the memory manager, such as the entries in the memory table. Objects are
+ * carved out of large slabs obtained with malloc, and objects that are
+ * released go onto a free list to be reused by the next allocation, so that
+ * the bookkeeping for each of the user's allocations does not itself cost a
+ * call to malloc.
+ *
+ * Individual objects are never returned to the system; all of the slabs are
+ * released at once when the allocator is destroyed. Objects can be allocated
+ * and released from several threads at once. This class is not intended to
+ * be used by clients.
+ */
+class slab_allocator
+{
+private:
+	/**
+	 * The header placed at the start of every slab, linking together all of
+	 * the slabs owned by the allocator so that they can be released.
+	 */
+	struct slab
+	{
+		slab* next;
+	};
+
+	/**
+	 * The size of each object, rounded up to the arena alignment.
+	 */
+	size_t _object_size;
+
+	/**
+	 * The number of objects that fit in a single slab.
+	 */
+	size_t _objects_per_slab;
+
+	/**
+	 * The offset of the first object from the start of a slab. Objects whose
+	 * size is a whole number of cache lines are placed on cache line
+	 * boundaries, so that none of them straddles two lines.
+	 */
+	size_t _first_offset;
+
+	/**
+	 * The list of objects that have been released and can be reused. The
+	 * first word of each free object points to the next one.
+	 */
+	void* _free_list;
+
+	/**
+	 * The list of slabs obtained from the system.
+	 */
+	slab* _slabs;
+
+	/**
+	 * The number of slabs obtained from the system.
+	 */
+	size_t _slab_count;
+
+	/**
+	 * The number of objects that have been handed out by the allocator over
+	 * its lifetime.
+	 */
+	size_t _objects_served;
+
+	/**
+	 * Protects the free list and the list of slabs.
+	 */
+	mutex _lock;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Obtains a new slab from the system and threads its objects onto the
+	 * free list.
+	 *
+	 * @returns true if the slab was obtained; false if the system is out of
+	 *     memory
+	 */
+	bool grow();
+
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Initializes a new slab allocator that hands out objects of the
+	 * specified size.
+	 *
+	 * @param object_size the size of each object, in bytes
+	 */
+	explicit slab_allocator(size_t object_size = sizeof(void*));
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Changes the size of the objects handed out by the allocator. This can
+	 * only be called before the first object is allocated.
+	 *
+	 * @param object_size the size of each object, in bytes
+	 */
+	void set_object_size(size_t object_size);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Releases every slab owned by the allocator. Any objects that are still
+	 * in use become invalid.
+	 */
+	~slab_allocator();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Allocates an object from the allocator. The contents of the object are
+	 * undefined.
+	 *
+	 * @returns a pointer to the object, or NULL if the system is out of
+	 *     memory
+	 */
+	void* allocate();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns an object to the allocator so that it can be reused.
+	 *
+	 * @param object an object obtained from this allocator's allocate
+	 *     method; NULL is ignored
+	 */
+	void release(void* object);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of bytes that this allocator has obtained from the
+	 * system.
+	 */
+	size_t bytes_reserved() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of slabs that this allocator has obtained from the
+	 * system.
+	 */
+	size_t slab_count() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of objects that this allocator has handed out over its
+	 * lifetime.
+	 */
+	size_t objects_served() const;
+
+private:
+	// Slab allocators own their memory, so they cannot be copied.
+	slab_allocator(const slab_allocator&);
+	slab_allocator& operator=(const slab_allocator&);
+};
+
+
+// ===========================================================================
+/**
+ * A pool of backtrace arrays, grouped into size classes that each double the
+ * capacity of the previous one. Each size class is served by its own slab
+ * allocator. The array returned to the caller is preceded by one hidden slot
+ * that records the size class it came from, so that it can be returned to
+ * the right allocator when it is freed. Backtraces too long for the largest
+ * size class are allocated directly with malloc.
+ *
+ * This class is not intended to be used by clients; platforms should use the
+ * Dereferee::allocate_backtrace_array and Dereferee::free_backtrace_array
+ * functions declared in <dereferee/platform.h>, which draw from the memory
+ * manager's pool.
+ */
+class backtrace_pool
+{
+public:
+	/**
+	 * The number of size classes in the pool.
+	 */
+	enum { size_class_count = 7 };
+
+	/**
+	 * The number of slots (including the hidden slot) in the arrays of the
+	 * smallest size class.
+	 */
+	enum { smallest_size_class = 8 };
+
+private:
+	/**
+	 * The slab allocators that serve each size class.
+	 */
+	slab_allocator _size_classes[size_class_count];
+
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Initializes a new, empty backtrace pool.
+	 */
+	backtrace_pool();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Releases every array owned by the pool, except for oversized arrays
+	 * that were allocated with malloc and are still in use.
+	 */
+	~backtrace_pool();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Allocates a zero-filled backtrace array with room for the specified
+	 * number of entries (including the NULL terminator).
+	 *
+	 * @param entries the number of entries needed
+	 * @returns the array, or NULL if the system is out of memory
+	 */
+	void** allocate(size_t entries);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a backtrace array to the pool.
+	 *
+	 * @param backtrace an array obtained from this pool's allocate method;
+	 *     NULL is ignored
+	 */
+	void release(void** backtrace);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of bytes that the pool has obtained from the system
+	 * in slabs.
+	 */
+	size_t bytes_reserved() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of slabs that the pool has obtained from the system.
+	 */
+	size_t slab_count() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of arrays that the pool has handed out from its slabs
+	 * over its lifetime.
+	 */
+	size_t objects_served() const;
+
+private:
+	// Backtrace pools own their memory, so they cannot be copied.
+	backtrace_pool(const backtrace_pool&);
+	backtrace_pool& operator=(const backtrace_pool&);
+};
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::slab_allocator methods.
+ */
+
+// ---------------------------------------------------------------------------
+inline slab_allocator::slab_allocator(size_t object_size)
+{
+	_free_list = NULL;
+	_slabs = NULL;
+	_slab_count = 0;
+	_objects_served = 0;
+
+	set_object_size(object_size);
+}
+
+// ---------------------------------------------------------------------------
+inline void slab_allocator::set_object_size(size_t object_size)
+{
+	assert(_slabs == NULL);
+
+	if(object_size < sizeof(void*))
+		object_size = sizeof(void*);
+
+	_object_size = (object_size + DEREFEREE_ARENA_ALIGNMENT - 1)
+		& ~(size_t)(DEREFEREE_ARENA_ALIGNMENT - 1);
+
+	_objects_per_slab = (DEREFEREE_ARENA_SLAB_SIZE - DEREFEREE_ARENA_ALIGNMENT)
+		/ _object_size;
+
+	if(_objects_per_slab == 0)
+		_objects_per_slab = 1;
+
+	// malloc aligns the slab to DEREFEREE_ARENA_ALIGNMENT, so at most this
+	// much padding is needed to reach the next cache line boundary.
+	_first_offset = DEREFEREE_ARENA_ALIGNMENT;
+
+	if(_object_size % DEREFEREE_CACHE_LINE_SIZE == 0)
+		_first_offset = DEREFEREE_CACHE_LINE_SIZE;
+}
+
+// ---------------------------------------------------------------------------
+inline slab_allocator::~slab_allocator()
+{
+	while(_slabs)
+	{
+		slab* next = _slabs->next;
+		free(_slabs);
+		_slabs = next;
+	}
+}
+
+// ---------------------------------------------------------------------------
+inline bool slab_allocator::grow()
+{
+	slab* new_slab = (slab*)malloc(_first_offset
+		+ _objects_per_slab * _object_size);
+
+	if(!new_slab)
+		return false;
+
+	new_slab->next = _slabs;
+	_slabs = new_slab;
+	_slab_count++;
+
+	// Thread the objects onto the free list in reverse so that they are
+	// handed out in address order.
+	char* first = (char*)new_slab + DEREFEREE_ARENA_ALIGNMENT;
+
+	if(_first_offset > DEREFEREE_ARENA_ALIGNMENT)
+	{
+		first = (char*)(((size_t)first + DEREFEREE_CACHE_LINE_SIZE - 1)
+			& ~(size_t)(DEREFEREE_CACHE_LINE_SIZE - 1));
+	}
+
+	for(size_t i = _objects_per_slab; i > 0; i--)
+	{
+		void** object = (void**)(first + (i - 1) * _object_size);
+		*object = _free_list;
+		_free_list = object;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+inline void* slab_allocator::allocate()
+{
+	scoped_lock lock(_lock);
+
+	if(!_free_list && !grow())
+		return NULL;
+
+	void** object = (void**)_free_list;
+	_free_list = *object;
+	_objects_served++;
+
+	return object;
+}
+
+// ---------------------------------------------------------------------------
+inline void slab_allocator::release(void* object)
+{
+	if(object)
+	{
+		scoped_lock lock(_lock);
+
+		*(void**)object = _free_list;
+		_free_list = object;
+	}
+}
+
+// ---------------------------------------------------------------------------
+inline size_t slab_allocator::bytes_reserved() const
+{
+	return _slab_count
+		* (_first_offset + _objects_per_slab * _object_size);
+}
+
+// ---------------------------------------------------------------------------
+inline size_t slab_allocator::slab_count() const
+{
+	return _slab_count;
+}
+
+// ---------------------------------------------------------------------------
+inline size_t slab_allocator::objects_served() const
+{
+	return _objects_served;
+}
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::backtrace_pool methods.
+ */
+
+// ---------------------------------------------------------------------------
+inline backtrace_pool::backtrace_pool()
+{
+	for(size_t i = 0; i < size_class_count; i++)
+	{
+		_size_classes[i].set_object_size(
+			((size_t)smallest_size_class << i) * sizeof(void*));
+	}
+}
+
+// ---------------------------------------------------------------------------
+inline backtrace_pool::~backtrace_pool()
+{
+}
+
+// ---------------------------------------------------------------------------
+inline void** backtrace_pool::allocate(size_t entries)
+{
+	size_t slots = entries + 1;
+	size_t index = 0;
+
+	while(index < size_class_count
+		&& ((size_t)smallest_size_class << index) < slots)
+	{
+		index++;
+	}
+
+	void** array;
+
+	if(index < size_class_count)
+	{
+		array = (void**)_size_classes[index].allocate();
+		if(!array)
+			return NULL;
+
+		memset(array, 0, slots * sizeof(void*));
+	}
+	else
+	{
+		array = (void**)calloc(slots, sizeof(void*));
+		if(!array)
+			return NULL;
+	}
+
+	array[0] = (void*)index;
+	return array + 1;
+}
+
+// ---------------------------------------------------------------------------
+inline void backtrace_pool::release(void** backtrace)
+{
+	if(backtrace)
+	{
+		void** array = backtrace - 1;
+		size_t index = (size_t)array[0];
+
+		if(index < size_class_count)
+			_size_classes[index].release(array);
+		else
+			free(array);
+	}
+}
+
+// ---------------------------------------------------------------------------
+inline size_t backtrace_pool::bytes_reserved() const
+{
+	size_t total = 0;
+
+	for(size_t i = 0; i < size_class_count; i++)
+		total += _size_classes[i].bytes_reserved();
+
+	return total;
+}
+
+// ---------------------------------------------------------------------------
+inline size_t backtrace_pool::slab_count() const
+{
+	size_t total = 0;
+
+	for(size_t i = 0; i < size_class_count; i++)
+		total += _size_classes[i].slab_count();
+
+	return total;
+}
+
+// ---------------------------------------------------------------------------
+inline size_t backtrace_pool::objects_served() const
+{
+	size_t total = 0;
+
+	for(size_t i = 0; i < size_class_count; i++)
+		total += _size_classes[i].objects_served();
+
+	return total;
+}
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_ARENA_H
@@ -0,0 +1,317 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_BACKTRACE_TABLE_H
+#define DEREFEREE_BACKTRACE_TABLE_H
+
+#include <cstdlib>
+#include <cstring>
+
+#include <dereferee/types.h>
+#include <dereferee/threads.h>
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/**
+ * The number of backtraces stored in each chunk of a backtrace_table.
+ */
+#define DEREFEREE_BACKTRACES_PER_CHUNK 256
+
+/**
+ * The largest number of chunks in a backtrace_table, which limits the number
+ * of distinct backtraces that can be interned. Allocations made once the
+ * table is full are recorded without a backtrace.
+ */
+#define DEREFEREE_BACKTRACE_CHUNKS 4096
+
+
+// ===========================================================================
+/**
+ * A table that stores a single copy of each distinct backtrace and assigns
+ * it a small integer identifier. Allocations made in a loop, or from the
+ * same place in a program by any other path, share identical backtraces, so
+ * the memory table records the identifier of each block's backtrace rather
+ * than a copy of it. Blocks with the same identifier were allocated at the
+ * same site, which lets leaks be grouped by site when they are reported.
+ *
+ * Backtraces are never removed, since a program has only as many distinct
+ * allocation sites as its call structure allows. They are stored in chunks
+ * that never move once allocated, so a backtrace can be looked up by its
+ * identifier without a lock. Interning a backtrace takes the table's lock.
+ *
+ * Like type_name_table, the table needs no initialization beyond
+ * zero-filling and has no destructor, so that backtraces remain valid while
+ * the final leak report is being made. This class is not intended to be
+ * used by clients.
+ */
+class backtrace_table
+{
+private:
+	/**
+	 * The chunks of backtraces, in the order that they were interned. The
+	 * backtrace with identifier n is entry
+	 * (n - 1) % DEREFEREE_BACKTRACES_PER_CHUNK of chunk
+	 * (n - 1) / DEREFEREE_BACKTRACES_PER_CHUNK.
+	 */
+	void*** _chunks[DEREFEREE_BACKTRACE_CHUNKS];
+
+	/**
+	 * The number of backtraces in the table.
+	 */
+	backtrace_t _count;
+
+	/**
+	 * An open-addressed hash table that maps backtraces to their
+	 * identifiers. Each slot holds the identifier of a backtrace, or zero if
+	 * the slot is empty.
+	 */
+	backtrace_t* _slots;
+
+	/**
+	 * The number of slots in the hash table (always zero or a power of two).
+	 */
+	size_t _slot_count;
+
+	/**
+	 * Protects the table while a backtrace is being interned.
+	 */
+	mutex _lock;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a hash code for the specified backtrace.
+	 */
+	static size_t hash(void** frames);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns true if the two backtraces contain the same frames.
+	 */
+	static bool equal(void** lhs, void** rhs);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Doubles the size of the hash table, or creates it if it does not yet
+	 * exist.
+	 *
+	 * @returns true if the table was grown; false if the system is out of
+	 *     memory
+	 */
+	bool grow_slots();
+
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the identifier of the specified backtrace, adding a copy of
+	 * the backtrace to the table if it is not already there. The caller
+	 * keeps ownership of the array that is passed in.
+	 *
+	 * @param frames the backtrace to intern, as an array of addresses where
+	 *     the last entry is NULL
+	 * @returns the identifier of the backtrace, or 0 if frames is NULL or
+	 *     the backtrace could not be added to the table
+	 */
+	backtrace_t intern(void** frames);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the backtrace with the specified identifier.
+	 *
+	 * @param id an identifier returned by intern
+	 * @returns the backtrace, or NULL if the identifier is 0
+	 */
+	void** frames(backtrace_t id) const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the number of backtraces in the table, which is also the
+	 * largest identifier that has been assigned.
+	 */
+	backtrace_t count() const;
+};
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::backtrace_table methods.
+ */
+
+// ---------------------------------------------------------------------------
+inline size_t backtrace_table::hash(void** frames)
+{
+	// FNV-1a, over the addresses rather than their bytes.
+	size_t code = (size_t)2166136261U;
+
+	for(; *frames; frames++)
+		code = (code ^ (size_t)*frames) * (size_t)16777619U;
+
+	return code;
+}
+
+// ---------------------------------------------------------------------------
+inline bool backtrace_table::equal(void** lhs, void** rhs)
+{
+	while(*lhs && *lhs == *rhs)
+	{
+		lhs++;
+		rhs++;
+	}
+
+	return *lhs == *rhs;
+}
+
+// ---------------------------------------------------------------------------
+inline bool backtrace_table::grow_slots()
+{
+	size_t new_count = _slot_count ? _slot_count * 2 : 256;
+	backtrace_t* new_slots =
+		(backtrace_t*)calloc(new_count, sizeof(backtrace_t));
+
+	if(!new_slots)
+		return false;
+
+	for(size_t i = 0; i < _slot_count; i++)
+	{
+		if(_slots[i] != 0)
+		{
+			size_t j = hash(frames(_slots[i])) & (new_count - 1);
+			while(new_slots[j] != 0)
+				j = (j + 1) & (new_count - 1);
+
+			new_slots[j] = _slots[i];
+		}
+	}
+
+	free(_slots);
+	_slots = new_slots;
+	_slot_count = new_count;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+inline backtrace_t backtrace_table::intern(void** frames_to_find)
+{
+	if(!frames_to_find)
+		return 0;
+
+	size_t code = hash(frames_to_find);
+
+	scoped_lock lock(_lock);
+
+	if(_slot_count)
+	{
+		size_t i = code & (_slot_count - 1);
+
+		while(_slots[i] != 0)
+		{
+			if(equal(frames(_slots[i]), frames_to_find))
+				return _slots[i];
+
+			i = (i + 1) & (_slot_count - 1);
+		}
+	}
+
+	// Keep the hash table at most half full so that probe sequences stay
+	// short.
+	if(2 * ((size_t)_count + 1) > _slot_count && !grow_slots())
+		return 0;
+
+	size_t chunk = _count / DEREFEREE_BACKTRACES_PER_CHUNK;
+	if(chunk >= DEREFEREE_BACKTRACE_CHUNKS)
+		return 0;
+
+	if(!_chunks[chunk])
+	{
+		_chunks[chunk] =
+			(void***)calloc(DEREFEREE_BACKTRACES_PER_CHUNK, sizeof(void**));
+
+		if(!_chunks[chunk])
+			return 0;
+	}
+
+	size_t length = 1;
+	while(frames_to_find[length - 1])
+		length++;
+
+	void** copy = (void**)malloc(length * sizeof(void*));
+	if(!copy)
+		return 0;
+
+	memcpy(copy, frames_to_find, length * sizeof(void*));
+	_chunks[chunk][_count % DEREFEREE_BACKTRACES_PER_CHUNK] = copy;
+
+	backtrace_t id = ++_count;
+
+	size_t i = code & (_slot_count - 1);
+	while(_slots[i] != 0)
+		i = (i + 1) & (_slot_count - 1);
+
+	_slots[i] = id;
+
+	return id;
+}
+
+// ---------------------------------------------------------------------------
+inline void** backtrace_table::frames(backtrace_t id) const
+{
+	if(id == 0)
+		return NULL;
+
+	return _chunks[(id - 1) / DEREFEREE_BACKTRACES_PER_CHUNK]
+		[(id - 1) % DEREFEREE_BACKTRACES_PER_CHUNK];
+}
+
+// ---------------------------------------------------------------------------
+inline backtrace_t backtrace_table::count() const
+{
+	return _count;
+}
+
+
+// ===========================================================================
+/*
+ * Access to the table of backtraces shared by the whole program.
+ */
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns the identifier of the specified backtrace in the table of
+ * backtraces shared by the whole program, adding the backtrace if necessary.
+ */
+backtrace_t intern_backtrace(void** frames);
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns the backtrace with the specified identifier from the table of
+ * backtraces shared by the whole program, or NULL if the identifier is 0.
+ */
+void** interned_backtrace(backtrace_t id);
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns the number of backtraces in the table of backtraces shared by the
+ * whole program.
+ */
+backtrace_t interned_backtrace_count();
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_BACKTRACE_TABLE_H
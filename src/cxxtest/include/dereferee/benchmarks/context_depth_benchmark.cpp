@@ -0,0 +1,158 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// ===========================================================================
+/**
+ * A standalone micro-benchmark that measures what it costs to enter and
+ * leave a _TS_TRY_WITH_SIGNAL_PROTECTION region at increasing depths of
+ * saved contexts, using the gcc_bfd_platform that the plug-in runs tests
+ * with. Each protected region saves the platform's context on entry and
+ * restores it on exit.
+ *
+ * CxxTest allows only __cxxtest_jmpmax nested protected regions, so the
+ * first table nests the macro itself as deeply as it allows. The second
+ * table reaches far deeper by saving contexts directly before timing a
+ * single region, which crosses the point where the platform's fixed
+ * context array gives way to chunks drawn from the manager. Both tables
+ * should stay flat.
+ *
+ * Build and run it from this directory with:
+ *
+ *     g++ -std=c++11 -O2 -I../.. context_depth_benchmark.cpp \
+ *         -o context_depth_benchmark -lbfd -liberty -ldl -lpthread
+ *     ./context_depth_benchmark
+ */
+
+#define CXXTEST_TRAP_SIGNALS
+#define CXXTEST_TRACE_STACK
+
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <dereferee.h>
+#include <cxxtest/Flags.h>
+#include <cxxtest/Signals.h>
+#include <cxxtest/SuiteInitFailureTable.h>
+
+#include <dereferee/allocation_info_impl.cpp>
+#include <dereferee/manager.cpp>
+#include <dereferee/memtab.cpp>
+#include <dereferee/usage_stats_impl.cpp>
+#include <dereferee/stdio_listener.cpp>
+#include <dereferee/gcc_bfd_platform.cpp>
+#include <cxxtest/Signals.cpp>
+#include <cxxtest/_SignalsPOSIX.cpp>
+
+// ===========================================================================
+
+namespace
+{
+
+const int REGIONS = 1000000;
+
+/**
+ * The number of regions entered, kept volatile so that the compiler cannot
+ * discard the empty protected blocks being timed.
+ */
+volatile long entered = 0;
+
+// ----------------------------------------------------------------------
+/**
+ * Enters and leaves REGIONS protected regions in a row and returns the
+ * average cost of one, in nanoseconds.
+ */
+double time_regions()
+{
+	clock_t start = clock();
+
+	for(int i = 0; i < REGIONS; i++)
+	{
+		_TS_TRY_WITH_SIGNAL_PROTECTION
+		{
+			entered++;
+		}
+		_TS_CATCH_SIGNAL({ });
+	}
+
+	return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / REGIONS;
+}
+
+// ----------------------------------------------------------------------
+/**
+ * Nests depth protected regions inside each other and times the innermost
+ * one.
+ */
+double time_nested(int depth)
+{
+	if(depth <= 1)
+		return time_regions();
+
+	double ns = 0;
+
+	_TS_TRY_WITH_SIGNAL_PROTECTION
+	{
+		ns = time_nested(depth - 1);
+	}
+	_TS_CATCH_SIGNAL({ });
+
+	return ns;
+}
+
+// ----------------------------------------------------------------------
+/**
+ * Saves depth contexts directly on the platform, times one protected region
+ * on top of them, and then restores them again.
+ */
+double time_saved(int depth)
+{
+	Dereferee::platform* platform = Dereferee::current_platform();
+
+	for(int i = 0; i < depth; i++)
+		platform->save_current_context();
+
+	double ns = time_regions();
+
+	for(int i = 0; i < depth; i++)
+		platform->restore_current_context();
+
+	return ns;
+}
+
+} // end anonymous namespace
+
+// ----------------------------------------------------------------------
+int main()
+{
+	static const int saved_depths[] =
+		{ 0, 16, 62, 63, 64, 126, 127, 1000, 10000, 100000 };
+
+	printf("nested regions    ns per region\n");
+
+	for(int depth = 1; depth < CxxTest::__cxxtest_jmpmax; depth++)
+		printf("%14d %16.1f\n", depth, time_nested(depth));
+
+	printf("\nsaved contexts    ns per region\n");
+
+	for(size_t i = 0; i < sizeof(saved_depths) / sizeof(int); i++)
+	{
+		printf("%14d %16.1f\n", saved_depths[i],
+			time_saved(saved_depths[i]));
+	}
+
+	return 0;
+}
@@ -24,6 +24,44 @@
 namespace Dereferee
 {
 
+// ===========================================================================
+/**
+ * Stores the cookie size and array size of a block of memory holding an
+ * array of type T[] in its mem_info structure.
+ */
+template <typename T>
+inline void store_cookie_size(mem_info* info, size_t cookie_size)
+{
+	info->cookie_size = (unsigned int)cookie_size;
+	info->array_size = (info->block_size - cookie_size) / sizeof(T);
+	info->cookie_size_is_known = true;
+}
+
+// ===========================================================================
+/**
+ * Fills in the cookie size of an array block as soon as it is assigned to a
+ * checked pointer, if the size is known at compile time, so that arithmetic
+ * and indexing on the pointer never have to compute it. Otherwise this does
+ * nothing and calculating_bounds_checker computes the size on first use.
+ * (The trial allocation must not be instantiated here, since this is used
+ * for every type, including those that have no default constructor.)
+ */
+template <typename T, bool is_static = static_cookie<T>::is_known>
+struct eager_cookie
+{
+	static void fill(mem_info* info)
+	{
+		store_cookie_size<T>(info, static_cookie<T>::size);
+	}
+};
+
+template <typename T>
+struct eager_cookie<T, false>
+{
+	static void fill(mem_info* /* info */) { }
+};
+
+
 // ===========================================================================
 /**
  * A utility class used to determine if an address is within the bounds of
@@ -61,13 +99,26 @@ public:
 		// mem_info structure.
 		
 		if (info && !info->cookie_size_is_known)
-		{
-			info->cookie_size = cookie_calculator<T>::size();
-			info->array_size = (info->block_size - info->cookie_size)
-				/ sizeof(T);
-				
-			info->cookie_size_is_known = true;
-		}
+			store_cookie_size<T>(info, cookie_calculator<T>::size());
+	}
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the lowest address in the memory block that a pointer to an
+	 * element can hold; that is, the address of the first element.
+	 */
+	const char *lower_bound() const
+	{
+		return (const char *) addr_info->address + addr_info->cookie_size;
+	}
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the address one past the end of the memory block.
+	 */
+	const char *upper_bound() const
+	{
+		return (const char *) addr_info->address + addr_info->block_size;
 	}
 	
 	// -----------------------------------------------------------------------
@@ -96,15 +147,10 @@ public:
 
 		const char *p = (const char *) address;
 		
-		const char *lower_bound = (const char *) addr_info->address
-			+ addr_info->cookie_size;
-		const char *upper_bound = (const char *) addr_info->address
-			+ addr_info->block_size;
-		
 		if (inclusive)
-			return (lower_bound <= p && p <= upper_bound);
+			return (lower_bound() <= p && p <= upper_bound());
 		else
-			return (lower_bound <= p && p < upper_bound);
+			return (lower_bound() <= p && p < upper_bound());
 	}
 };
 
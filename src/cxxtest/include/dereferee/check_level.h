@@ -0,0 +1,97 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_CHECK_LEVEL_H
+#define DEREFEREE_CHECK_LEVEL_H
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/*
+ * The levels of checking that a checked pointer can perform. Each level
+ * includes the checks of the levels below it.
+ */
+
+/**
+ * Only dereferencing or indexing a null pointer is reported.
+ */
+#define DEREFEREE_CHECK_NULL 1
+
+/**
+ * Each pointer also records which block it was assigned, and using a pointer
+ * that is uninitialized or whose block has been deleted is reported.
+ * Assigning an address that did not come from new or new[] is reported.
+ */
+#define DEREFEREE_CHECK_LIVENESS 2
+
+/**
+ * Pointer arithmetic, indexing, dereferencing, comparison, and subtraction
+ * are also checked against the bounds of the pointer's block.
+ */
+#define DEREFEREE_CHECK_BOUNDS 3
+
+/**
+ * Each block also counts the pointers that refer to it, so that losing the
+ * last pointer to a block is reported as a leak when it happens. This is the
+ * level used when none is given.
+ */
+#define DEREFEREE_CHECK_LEAKS 4
+
+/**
+ * The level of checking done by pointers declared with checked(T*) or
+ * checked_ptr<T*>. Define this on the command line to change the default for
+ * a whole program; for example, a reference solution or an assignment that is
+ * graded on performance can be built with -DDEREFEREE_CHECK_LEVEL=2 without
+ * changing its source. Every file in a program must be compiled with the
+ * same setting.
+ */
+#ifndef DEREFEREE_CHECK_LEVEL
+#	define DEREFEREE_CHECK_LEVEL DEREFEREE_CHECK_LEAKS
+#endif
+
+
+// ===========================================================================
+/**
+ * A policy class that tells checked_ptr which checks to perform, given one
+ * of the levels above. A pointer with a level other than the default can be
+ * declared as checked_ptr<T*, Dereferee::check_level<N> >.
+ *
+ * Other policies can be written as classes with the same four members, but
+ * leak detection relies on the block that liveness checking records, so it
+ * should not be enabled without it. Pointers with different policies can be
+ * assigned to each other, but leaks are only detected among pointers that
+ * count references.
+ */
+template <int level>
+struct check_level
+{
+	static const bool check_null = (level >= DEREFEREE_CHECK_NULL);
+	static const bool check_liveness = (level >= DEREFEREE_CHECK_LIVENESS);
+	static const bool check_bounds = (level >= DEREFEREE_CHECK_BOUNDS);
+	static const bool check_leaks = (level >= DEREFEREE_CHECK_LEAKS);
+};
+
+/**
+ * The policy used by checked pointers for which none is given.
+ */
+typedef check_level<DEREFEREE_CHECK_LEVEL> default_checks;
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_CHECK_LEVEL_H
@@ -26,20 +26,34 @@ namespace Dereferee
  */
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::checked_ptr() :
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr() :
 	pointer(reinterpret_cast<pointer_type>(__DMI->uninit_handle())),
 	tag(default_memtag),
 	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
 {
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::checked_ptr(const checked_ptr<T>& src) :
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr(const checked_ptr<T, checks>& src) :
 	pointer(src.pointer),
 	tag(src.tag),
 	out_of_bounds(src.out_of_bounds)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(src.lower_bound),
+	upper_bound(src.upper_bound)
+#endif
 {
 	switch(src.state())
 	{
@@ -47,11 +61,22 @@ checked_ptr<T>::checked_ptr(const checked_ptr<T>& src) :
 		// When a checked_ptr pointer object is copied (due to aliasing or
 		// passing to a function), we increment the pointer's reference
 		// count if it is live.
-		
-		if(__DMI->is_checked(pointer, tag))
-			__DMI->retain(pointer);
+	{
+#ifdef DEREFEREE_CACHED_INFO
+		// The call to state() above has already validated the source's
+		// cached handle, so it can be shared.
+
+		cached_info = src.cached_info;
+		mem_info* addr_info = cached_info;
+#else
+		mem_info* addr_info = checks::check_leaks ? src.live_info() : NULL;
+#endif
+
+		if(checks::check_leaks && addr_info)
+			atomic_increment(addr_info->ref_count);
 		
 		break;
+	}
 		
 	case state_null:
 		break;
@@ -61,7 +86,7 @@ checked_ptr<T>::checked_ptr(const checked_ptr<T>& src) :
 		break;
 
 	case state_dead_deleted:
-		__DMI->error(error_assign_dead_deleted);
+		__DMI->deleted_pointer_error(error_assign_dead_deleted, src.tag);
 		break;
 
 	case state_dead_out_of_bounds:
@@ -70,208 +95,161 @@ checked_ptr<T>::checked_ptr(const checked_ptr<T>& src) :
 	}
 }
 
+#ifdef DEREFEREE_MOVE_SEMANTICS
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::checked_ptr(pointer_type ptr) :
-	pointer(ptr),
-	out_of_bounds(false)
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr(checked_ptr<T, checks>&& src) noexcept :
+	pointer(src.pointer),
+	tag(src.tag),
+	out_of_bounds(src.out_of_bounds)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(src.lower_bound),
+	upper_bound(src.upper_bound)
+#endif
 {
-	if(ptr != 0)
+	switch(src.state())
 	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
+	case state_alive:
+	case state_null:
+		// The source's reference to its block, if it holds one, now belongs
+		// to this pointer, so the reference count is left alone. Leaving the
+		// source null means that its destructor will not release the
+		// reference.
 
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return;
-		}
+#ifdef DEREFEREE_CACHED_INFO
+		cached_info = src.cached_info;
+#endif
+		src.release();
+		break;
 
-		store_type_info(addr_info);
+	// A dead source is reported just as it is when it is copied, and is
+	// left alone since it holds no reference to give up.
 
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
+	case state_dead_uninitialized:
+		__DMI->error(error_assign_dead_uninitialized);
+		break;
 
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
+	case state_dead_deleted:
+		__DMI->deleted_pointer_error(error_assign_dead_deleted, src.tag);
+		break;
+
+	case state_dead_out_of_bounds:
+		__DMI->error(error_assign_dead_out_of_bounds);
+		break;
 	}
 }
+#endif
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr(pointer_type ptr) :
+	pointer(ptr),
+	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
+{
+	attach();
+}
 
 #ifndef DEREFEREE_NO_DYNAMIC_CAST
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const dynamic_cast_helper<U*>& ptr) :
+checked_ptr<T, checks>::checked_ptr(const dynamic_cast_helper<U*>& ptr) :
 	pointer((pointer_type)ptr),
 	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
 {
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
-
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
+	attach();
 }
 
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const dynamic_cast_helper<U* const>& ptr) :
+checked_ptr<T, checks>::checked_ptr(
+	const dynamic_cast_helper<U* const>& ptr) :
 	pointer((pointer_type)ptr),
 	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
 {
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
-
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
+	attach();
 }
 #endif
 
 #ifndef DEREFEREE_NO_CONST_CAST
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const const_cast_helper<U*>& ptr) :
+checked_ptr<T, checks>::checked_ptr(const const_cast_helper<U*>& ptr) :
 	pointer((pointer_type)ptr),
 	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
 {
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
-
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
+	attach();
 }
 
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const const_cast_helper<U* const>& ptr) :
+checked_ptr<T, checks>::checked_ptr(
+	const const_cast_helper<U* const>& ptr) :
 	pointer((pointer_type)ptr),
 	out_of_bounds(false)
+#ifdef DEREFEREE_CACHED_INFO
+	, cached_info(NULL)
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	, lower_bound(NULL),
+	upper_bound(NULL)
+#endif
 {
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
-
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
+	attach();
 }
 #endif
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::~checked_ptr()
+template <typename T, typename checks>
+checked_ptr<T, checks>::~checked_ptr()
 {
 	// If the pointer table contains the pointer, then it is still
 	// alive and we decrement its reference count. If this causes the
 	// count to reach zero, then we have a live pointer going out of
 	// scope, which will result in a memory leak.
 
-	if(__DMI->is_checked(pointer, tag))
-	{
-		__DMI->release(pointer);
+	if(!checks::check_leaks)
+		return;
+
+	mem_info* addr_info = live_info();
 
-		if(__DMI->ref_count(pointer) == 0)
+	if(addr_info)
+	{
+		if(atomic_decrement(addr_info->ref_count) == 0)
 		{
 			__DMI->warning(warning_live_pointer_out_of_scope);
 		}
@@ -279,8 +257,9 @@ checked_ptr<T>::~checked_ptr()
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator=(const checked_ptr<T>& src)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	const checked_ptr<T, checks>& src)
 {
 	if(this != &src)
 	{
@@ -288,16 +267,17 @@ checked_ptr<T>& checked_ptr<T>::operator=(const checked_ptr<T>& src)
 		{
 		case state_alive:
 		case state_null:
+		{
 			// If the pointer to which assignment is being made is alive,
 			// decrement its reference count since we are writing over its
 			// value. If this causes the count to reach zero, then we have
 			// a memory leak because no references to the memory remain.
 			
-			if(__DMI->is_checked(pointer, tag))
+			mem_info* addr_info = checks::check_leaks ? live_info() : NULL;
+
+			if(addr_info)
 			{
-				__DMI->release(pointer);
-				
-				if(__DMI->ref_count(pointer) == 0)
+				if(atomic_decrement(addr_info->ref_count) == 0)
 				{
 					__DMI->warning(warning_live_pointer_overwritten);
 				}
@@ -306,23 +286,33 @@ checked_ptr<T>& checked_ptr<T>::operator=(const checked_ptr<T>& src)
 			pointer = src.pointer;
 			tag = src.tag;
 			out_of_bounds = src.out_of_bounds;
+#ifdef DEREFEREE_CACHED_INFO
+			cached_info = src.cached_info;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+			lower_bound = src.lower_bound;
+			upper_bound = src.upper_bound;
+#endif
 			
 			// Increment the reference count of the pointer that was used
 			// on the right-hand side of the assignment.
 			
-			if(__DMI->is_checked(pointer, tag))
+			addr_info = checks::check_leaks ? live_info() : NULL;
+
+			if(addr_info)
 			{
-				__DMI->retain(pointer);
+				atomic_increment(addr_info->ref_count);
 			}
 			
 			break;
+		}
 			
 		case state_dead_uninitialized:
 			__DMI->error(error_assign_dead_uninitialized);
 			break;
 
 		case state_dead_deleted:
-			__DMI->error(error_assign_dead_deleted);
+			__DMI->deleted_pointer_error(error_assign_dead_deleted, src.tag);
 			break;
 
 		case state_dead_out_of_bounds:
@@ -334,175 +324,157 @@ checked_ptr<T>& checked_ptr<T>::operator=(const checked_ptr<T>& src)
 	return *this;
 }
 
-#ifndef DEREFEREE_NO_DYNAMIC_CAST
+#ifdef DEREFEREE_MOVE_SEMANTICS
 // ------------------------------------------------------------------
-template <typename T>
-template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(const dynamic_cast_helper<U*>& ptr)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	checked_ptr<T, checks>&& src)
 {
-	pointer = ptr;
-	out_of_bounds = false;
-
-	if(ptr != 0)
+	if(this != &src)
 	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
+		switch(src.state())
 		{
-			__DMI->error(error_assign_non_new);
-			return *this;
-		}
+		case state_alive:
+		case state_null:
+		{
+			// Release this pointer's reference exactly as copy assignment
+			// does, then take over the source's reference without counting
+			// it again.
 
-		store_type_info(addr_info);
+			mem_info* addr_info = checks::check_leaks ? live_info() : NULL;
 
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
+			if(addr_info)
+			{
+				if(atomic_decrement(addr_info->ref_count) == 0)
+				{
+					__DMI->warning(warning_live_pointer_overwritten);
+				}
+			}
+
+			pointer = src.pointer;
+			tag = src.tag;
+			out_of_bounds = src.out_of_bounds;
+#ifdef DEREFEREE_CACHED_INFO
+			cached_info = src.cached_info;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+			lower_bound = src.lower_bound;
+			upper_bound = src.upper_bound;
+#endif
+
+			src.release();
+			break;
 		}
 
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
+		case state_dead_uninitialized:
+			__DMI->error(error_assign_dead_uninitialized);
+			break;
+
+		case state_dead_deleted:
+			__DMI->deleted_pointer_error(error_assign_dead_deleted, src.tag);
+			break;
+
+		case state_dead_out_of_bounds:
+			__DMI->error(error_assign_dead_out_of_bounds);
+			break;
+		}
 	}
-	
+
 	return *this;
 }
+#endif
 
+#ifndef DEREFEREE_NO_DYNAMIC_CAST
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(
-	const dynamic_cast_helper<U* const>& ptr)
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	const dynamic_cast_helper<U*>& ptr)
 {
 	pointer = ptr;
 	out_of_bounds = false;
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = NULL;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	lower_bound = NULL;
+	upper_bound = NULL;
+#endif
 
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
+	attach();
 
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return *this;
-		}
+	return *this;
+}
 
-		store_type_info(addr_info);
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+template <typename U>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	const dynamic_cast_helper<U* const>& ptr)
+{
+	pointer = ptr;
+	out_of_bounds = false;
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = NULL;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	lower_bound = NULL;
+	upper_bound = NULL;
+#endif
 
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
+	attach();
 
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
-	
 	return *this;
 }
 #endif
 
 #ifndef DEREFEREE_NO_CONST_CAST
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(const const_cast_helper<U*>& ptr)
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	const const_cast_helper<U*>& ptr)
 {
 	pointer = ptr;
 	out_of_bounds = false;
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = NULL;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	lower_bound = NULL;
+	upper_bound = NULL;
+#endif
 
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return *this;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
+	attach();
 
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
-	
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
 	const const_cast_helper<U* const>& ptr)
 {
 	pointer = ptr;
 	out_of_bounds = false;
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = NULL;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	lower_bound = NULL;
+	upper_bound = NULL;
+#endif
 
-	if(ptr != 0)
-	{
-		bool is_checked;
-		mem_info* addr_info = __DMI->address_info(ptr, &is_checked);
-
-		if(!addr_info)
-		{
-			__DMI->error(error_assign_non_new);
-			return *this;
-		}
-
-		store_type_info(addr_info);
-
-		if(is_checked)
-		{
-			tag = addr_info->tag;
-		}
-		else
-		{
-			tag = __DMI->move_to_checked(ptr);
-		}
+	attach();
 
-		__DMI->retain(pointer);
-	}
-	else
-	{
-		tag = default_memtag;
-	}
-	
 	return *this;
 }
 #endif
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator==(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator==(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	pointer_state lhs_state = lhs.state();
 	pointer_state rhs_state = rhs.state();
@@ -512,10 +484,13 @@ bool operator==(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 	{
 		__DMI->error(error_compare_dead_out_of_bounds);
 	}
-	else if(lhs_state == state_dead_deleted ||
-			rhs_state == state_dead_deleted)
+	else if(lhs_state == state_dead_deleted)
+	{
+		__DMI->deleted_pointer_error(error_compare_dead_deleted, lhs.tag);
+	}
+	else if(rhs_state == state_dead_deleted)
 	{
-		__DMI->error(error_compare_dead_deleted);
+		__DMI->deleted_pointer_error(error_compare_dead_deleted, rhs.tag);
 	}
 	else if(lhs_state == state_dead_uninitialized ||
 			rhs_state == state_dead_uninitialized)
@@ -528,151 +503,117 @@ bool operator==(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator!=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator!=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return !(lhs == rhs);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator<(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator<(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	do_relational_check(lhs, rhs);
 	return (lhs.pointer < rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator<=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator<=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	do_relational_check(lhs, rhs);
 	return (lhs.pointer <= rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator>(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator>(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	do_relational_check(lhs, rhs);
 	return (lhs.pointer > rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator>=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator>=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	do_relational_check(lhs, rhs);
 	return (lhs.pointer >= rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator++()
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator++()
 {
-	mem_info* addr_info = __DMI->address_info(pointer);
-
-	pointer++;
-
-	if(!addr_info)
-	{
-		__DMI->error(error_pointer_not_found);
-	}
-	else if(!calculating_bounds_checker<value_type>(addr_info)
-		.contains(pointer, true))
-	{
-		out_of_bounds = true;
-		__DMI->error(error_arithmetic_moved_out_of_bounds);
-	}
-
-	// Post error behavior: Do nothing, this is not an unrecoverable error.
+	move_to(pointer + 1);
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T> checked_ptr<T>::operator++(int)
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::operator++(int)
 {
-	checked_ptr<T> retval = *this;
+	checked_ptr<T, checks> retval = *this;
 	++(*this);
 	return retval;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator--()
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator--()
 {
-	mem_info* addr_info = __DMI->address_info(pointer);
-	
-	pointer--;
-	
-	if(!addr_info)
-	{
-		__DMI->error(error_pointer_not_found);
-	}
-	else if(!calculating_bounds_checker<value_type>(addr_info)
-		.contains(pointer, true))
-	{
-		out_of_bounds = true;
-		__DMI->error(error_arithmetic_moved_out_of_bounds);
-	}
-	
-	// Post error behavior: Do nothing, this is not an unrecoverable error.
+	move_to(pointer - 1);
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T> checked_ptr<T>::operator--(int)
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::operator--(int)
 {
-	checked_ptr<T> retval = *this;
+	checked_ptr<T, checks> retval = *this;
 	--(*this);
 	return retval;	
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator+(const checked_ptr<U>& ptr, ptrdiff_t delta)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator+(const checked_ptr<U, UC>& ptr, ptrdiff_t delta)
 {
-	mem_info* addr_info = __DMI->address_info(ptr.pointer);
-	bool out_of_bounds = false;
+	// Each path returns a temporary, so that the copy of the result is
+	// elided (which would otherwise report an error if the result is out of
+	// bounds). Without bounds checks, or once the bounds are known, the
+	// result is copied from the original pointer rather than looked up in
+	// the memory table.
+
+	if(!UC::check_bounds)
+		return ptr.moved_copy(delta);
+
+#ifdef DEREFEREE_FAT_POINTERS
+	if(ptr.lower_bound && !ptr.out_of_bounds)
+		return ptr.moved_copy(delta);
+#endif
 
-	U new_pointer = ptr.pointer + delta;
-	
-	if(!addr_info)
-	{
-		__DMI->error(error_pointer_not_found);
-	}
-	else if(!calculating_bounds_checker<typename checked_ptr<U>::value_type>
-		(addr_info).contains(new_pointer, true))
-	{
-		out_of_bounds = true;
-		__DMI->error(error_arithmetic_moved_out_of_bounds);
-	}
-	
-	// Post error behavior: Do nothing, this is not an unrecoverable error.
-	checked_ptr<U> result(new_pointer);
-	result.out_of_bounds = out_of_bounds;
-	return result;
+	return ptr.located_copy(delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator+(ptrdiff_t delta, const checked_ptr<U>& ptr)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator+(ptrdiff_t delta, const checked_ptr<U, UC>& ptr)
 {
 	return (ptr + delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator-(const checked_ptr<U>& ptr, ptrdiff_t delta)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator-(const checked_ptr<U, UC>& ptr, ptrdiff_t delta)
 {
 	return (ptr + -delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-ptrdiff_t operator-(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+ptrdiff_t operator-(const checked_ptr<U, UC>& lhs,
+	const checked_ptr<V, VC>& rhs)
 {
 	pointer_state lhs_state = lhs.state();
 	pointer_state rhs_state = rhs.state();
@@ -682,7 +623,8 @@ ptrdiff_t operator-(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 
 	if(lhs_is_null != rhs_is_null)
 	{
-		__DMI->error(error_subtraction_one_side_null);
+		if(UC::check_null || VC::check_null)
+			__DMI->error(error_subtraction_one_side_null);
 	}
 	else
 	{
@@ -691,20 +633,25 @@ ptrdiff_t operator-(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 		{
 			__DMI->error(error_arithmetic_dead_out_of_bounds);
 		}
-		else if(lhs_state == state_dead_deleted ||
-				rhs_state == state_dead_deleted)
+		else if(lhs_state == state_dead_deleted)
+		{
+			__DMI->deleted_pointer_error(error_arithmetic_dead_deleted,
+				lhs.tag);
+		}
+		else if(rhs_state == state_dead_deleted)
 		{
-			__DMI->error(error_arithmetic_dead_deleted);
+			__DMI->deleted_pointer_error(error_arithmetic_dead_deleted,
+				rhs.tag);
 		}
 		else if(lhs_state == state_dead_uninitialized ||
 				rhs_state == state_dead_uninitialized)
 		{
 			__DMI->error(error_arithmetic_dead_uninitialized);
 		}
-		else
+		else if(UC::check_bounds || VC::check_bounds)
 		{
-			const mem_info* lhs_info = __DMI->address_info(lhs.pointer);
-			const mem_info* rhs_info = __DMI->address_info(rhs.pointer);
+			const mem_info* lhs_info = lhs.block_info();
+			const mem_info* rhs_info = rhs.block_info();
 			
 			if(lhs_info != rhs_info)
 			{
@@ -718,38 +665,24 @@ ptrdiff_t operator-(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator+=(ptrdiff_t delta)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator+=(ptrdiff_t delta)
 {
-	mem_info* addr_info = __DMI->address_info(pointer);
-	
-	pointer += delta;
-	
-	if(!addr_info)
-	{
-		__DMI->error(error_pointer_not_found);
-	}
-	else if(!calculating_bounds_checker<value_type>(addr_info)
-		.contains(pointer, true))
-	{
-		out_of_bounds = true;
-		__DMI->error(error_arithmetic_moved_out_of_bounds);
-	}
-	
-	// Post error behavior: Do nothing, this is not an unrecoverable error.
+	move_to(pointer + delta);
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator-=(ptrdiff_t delta)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator-=(ptrdiff_t delta)
 {
 	return (*this += -delta);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::reference_type
+checked_ptr<T, checks>::operator*()
 {
 	switch(state())
 	{
@@ -757,7 +690,8 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
 		break;
 
 	case state_null:
-		__DMI->error(error_deref_null_star_op);
+		if(checks::check_null)
+			__DMI->error(error_deref_null_star_op);
 		break;
 
 	case state_dead_uninitialized:
@@ -765,7 +699,7 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
 		break;
 		
 	case state_dead_deleted:
-		__DMI->error(error_deref_deleted_star_op);
+		__DMI->deleted_pointer_error(error_deref_deleted_star_op, tag);
 		break;
 		
 	case state_dead_out_of_bounds:
@@ -773,10 +707,14 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
 		break;
 	}
 	
-	const mem_info* addr_info = __DMI->address_info(pointer);
-	if(!noncalculating_bounds_checker<T>(addr_info).contains(pointer, false))
+	if(checks::check_bounds)
 	{
-		__DMI->error(error_deref_out_of_bounds_star_op);
+		const mem_info* addr_info = block_info();
+		if(!noncalculating_bounds_checker<T>(addr_info)
+			.contains(pointer, false))
+		{
+			__DMI->error(error_deref_out_of_bounds_star_op);
+		}
 	}
 
 	// Post error behavior: There is nothing we can do here, we have to
@@ -785,8 +723,9 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->() const
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::pointer_type
+checked_ptr<T, checks>::operator->() const
 {
 	switch(state())
 	{
@@ -794,7 +733,8 @@ typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->() const
 		break;
 
 	case state_null:
-		__DMI->error(error_deref_null_arrow_op);
+		if(checks::check_null)
+			__DMI->error(error_deref_null_arrow_op);
 		break;
 
 	case state_dead_uninitialized:
@@ -802,7 +742,7 @@ typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->() const
 		break;
 		
 	case state_dead_deleted:
-		__DMI->error(error_deref_deleted_arrow_op);
+		__DMI->deleted_pointer_error(error_deref_deleted_arrow_op, tag);
 		break;
 		
 	case state_dead_out_of_bounds:
@@ -810,10 +750,14 @@ typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->() const
 		break;
 	}
 
-	const mem_info* addr_info = __DMI->address_info(pointer);
-	if(!noncalculating_bounds_checker<T>(addr_info).contains(pointer, false))
+	if(checks::check_bounds)
 	{
-		__DMI->error(error_deref_out_of_bounds_star_op);
+		const mem_info* addr_info = block_info();
+		if(!noncalculating_bounds_checker<T>(addr_info)
+			.contains(pointer, false))
+		{
+			__DMI->error(error_deref_out_of_bounds_star_op);
+		}
 	}
 
 	// Post error behavior: There is nothing we can do here, we have to
@@ -822,8 +766,8 @@ typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->() const
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::operator pointer_type() const
+template <typename T, typename checks>
+checked_ptr<T, checks>::operator pointer_type() const
 {
 	switch(state())
 	{
@@ -836,7 +780,7 @@ checked_ptr<T>::operator pointer_type() const
 		break;
 		
 	case state_dead_deleted:
-		__DMI->error(error_used_dead_deleted);
+		__DMI->deleted_pointer_error(error_used_dead_deleted, tag);
 		break;
 		
 	case state_dead_out_of_bounds:
@@ -850,17 +794,17 @@ checked_ptr<T>::operator pointer_type() const
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-template <typename U>
-checked_ptr<T>::operator checked_ptr<U>() const
+template <typename T, typename checks>
+template <typename U, typename UC>
+checked_ptr<T, checks>::operator checked_ptr<U, UC>() const
 {
-	return checked_ptr<U>(pointer);
+	return checked_ptr<U, UC>(pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
-	const
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::reference_type
+checked_ptr<T, checks>::operator[](int index) const
 {
 	switch(state())
 	{
@@ -868,7 +812,8 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
 		break;
 
 	case state_null:
-		__DMI->error(error_deref_null_index_op);
+		if(checks::check_null)
+			__DMI->error(error_deref_null_index_op);
 		break;
 
 	case state_dead_uninitialized:
@@ -876,7 +821,7 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
 		break;
 		
 	case state_dead_deleted:
-		__DMI->error(error_deref_deleted_index_op);
+		__DMI->deleted_pointer_error(error_deref_deleted_index_op, tag);
 		break;
 		
 	case state_dead_out_of_bounds:
@@ -886,7 +831,7 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
 
 	pointer_type new_pointer = pointer + index;
 
-	mem_info* addr_info = __DMI->address_info(pointer);
+	mem_info* addr_info = checks::check_bounds ? block_info() : NULL;
 
 	if(addr_info)
 	{
@@ -896,7 +841,7 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
 		}
 		else
 		{
-			calculating_bounds_checker<T> checker(addr_info);
+			calculating_bounds_checker<value_type> checker(addr_info);
 			
 			if(!checker.contains(new_pointer, false))
 			{
@@ -912,19 +857,20 @@ typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-pointer_state checked_ptr<T>::state() const
+template <typename T, typename checks>
+pointer_state checked_ptr<T, checks>::state() const
 {
 	// The order of these checks matters -- for example, the out-of-bounds
 	// check comes first because it could be confused with the deleted state,
-	// since manager::is_checked would return false if the pointer was moved
+	// since manager::checked_info would return NULL if the pointer was moved
 	// far enough out of its memory block.
 
 	if(out_of_bounds)
 	{
 		return state_dead_out_of_bounds;
 	}
-	else if(pointer == reinterpret_cast<pointer_type>(__DMI->uninit_handle()))
+	else if(checks::check_liveness &&
+		pointer == reinterpret_cast<pointer_type>(__DMI->uninit_handle()))
 	{
 		return state_dead_uninitialized;
 	}
@@ -932,7 +878,7 @@ pointer_state checked_ptr<T>::state() const
 	{
 		return state_null;
 	}
-	else if(!__DMI->is_checked(pointer, tag))
+	else if(checks::check_liveness && !live_info())
 	{
 		return state_dead_deleted;
 	}
@@ -943,37 +889,241 @@ pointer_state checked_ptr<T>::state() const
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-void checked_ptr<T>::store_type_info(mem_info* addr_info)
+template <typename T, typename checks>
+mem_info* checked_ptr<T, checks>::live_info() const
 {
-	// Initialize supplemental information for the memory block that could
-	// not be computed in operator new.
+#ifdef DEREFEREE_CACHED_INFO
+	return __DMI->checked_info(pointer, tag, cached_info);
+#else
+	mem_info* hint = NULL;
+	return __DMI->checked_info(pointer, tag, hint);
+#endif
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+mem_info* checked_ptr<T, checks>::block_info() const
+{
+	// Only a dead pointer needs a separate search for whatever block now
+	// contains its address.
+
+	mem_info* addr_info = live_info();
+
+	if(!addr_info)
+		addr_info = __DMI->address_info(pointer);
+
+	return addr_info;
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+void checked_ptr<T, checks>::attach()
+{
+	tag = default_memtag;
 
+	if(pointer == 0 || !checks::check_liveness)
+		return;
+
+	bool is_checked;
+	mem_info* addr_info = __DMI->address_info(pointer, &is_checked);
+
+	if(!addr_info)
+	{
+		__DMI->error(error_assign_non_new);
+		return;
+	}
+
+	store_type_info(addr_info);
+
+	if(is_checked)
+	{
+		tag = addr_info->tag;
+	}
+	else
+	{
+		tag = __DMI->move_to_checked(pointer);
+	}
+
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = addr_info;
+#endif
+
+	if(checks::check_leaks)
+		atomic_increment(addr_info->ref_count);
+}
+
+#ifdef DEREFEREE_MOVE_SEMANTICS
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+void checked_ptr<T, checks>::release()
+{
+	pointer = 0;
+	tag = default_memtag;
+	out_of_bounds = false;
+#ifdef DEREFEREE_CACHED_INFO
+	cached_info = NULL;
+#endif
+#ifdef DEREFEREE_FAT_POINTERS
+	lower_bound = NULL;
+	upper_bound = NULL;
+#endif
+}
+#endif
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+void checked_ptr<T, checks>::move_to(pointer_type new_pointer)
+{
+	if(!checks::check_bounds)
+	{
+		pointer = new_pointer;
+		return;
+	}
+
+#ifdef DEREFEREE_FAT_POINTERS
+	// A pointer that has been moved out of bounds stays dead, and takes the
+	// slower path below so that further arithmetic on it is still reported.
+	if(lower_bound && !out_of_bounds)
+	{
+		pointer = new_pointer;
+
+		const char* p = (const char*)new_pointer;
+		if(p < lower_bound || p > upper_bound)
+		{
+			out_of_bounds = true;
+			__DMI->error(error_arithmetic_moved_out_of_bounds);
+		}
+
+		// Post error behavior: Do nothing, this is not an unrecoverable
+		// error.
+		return;
+	}
+#endif
+
+	mem_info* addr_info = block_info();
+
+	pointer = new_pointer;
+
+	if(!addr_info)
+	{
+		__DMI->error(error_pointer_not_found);
+	}
+	else
+	{
+		calculating_bounds_checker<value_type> checker(addr_info);
+
+#ifdef DEREFEREE_FAT_POINTERS
+		// Only the bounds of the block with this pointer's tag are kept;
+		// block_info finds some other block if the pointer is dead.
+		if(addr_info->is_checked && addr_info->tag == tag && !out_of_bounds)
+		{
+			lower_bound = checker.lower_bound();
+			upper_bound = checker.upper_bound();
+		}
+#endif
+
+		if(!checker.contains(pointer, true))
+		{
+			out_of_bounds = true;
+			__DMI->error(error_arithmetic_moved_out_of_bounds);
+		}
+	}
+
+	// Post error behavior: Do nothing, this is not an unrecoverable error.
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::moved_copy(ptrdiff_t delta)
+	const
+{
+	checked_ptr<T, checks> result(*this);
+	result.move_to(pointer + delta);
+	return result;
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::located_copy(ptrdiff_t delta)
+	const
+{
+	mem_info* addr_info = block_info();
+	bool new_out_of_bounds = false;
+
+	pointer_type new_pointer = pointer + delta;
+	
+	if(!addr_info)
+	{
+		__DMI->error(error_pointer_not_found);
+	}
+	else
+	{
+		calculating_bounds_checker<value_type> checker(addr_info);
+
+#ifdef DEREFEREE_FAT_POINTERS
+		if(addr_info->is_checked && addr_info->tag == tag && !out_of_bounds)
+		{
+			lower_bound = checker.lower_bound();
+			upper_bound = checker.upper_bound();
+		}
+#endif
+
+		if(!checker.contains(new_pointer, true))
+		{
+			new_out_of_bounds = true;
+			__DMI->error(error_arithmetic_moved_out_of_bounds);
+		}
+	}
+	
+	// Post error behavior: Do nothing, this is not an unrecoverable error.
+	checked_ptr<T, checks> result(new_pointer);
+	result.out_of_bounds = new_out_of_bounds;
+	return result;
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+typename_t checked_ptr<T, checks>::intern_current_type_name()
+{
 	char type_name[DEREFEREE_MAX_SYMBOL_LEN];
 #ifdef _MSC_VER
-	strncpy_s(type_name, DEREFEREE_MAX_SYMBOL_LEN, typeid(value_type).name(),
-		_TRUNCATE);
+	strncpy_s(type_name, DEREFEREE_MAX_SYMBOL_LEN,
+		typeid(value_type).name(), _TRUNCATE);
 #else
-	strncpy(type_name, typeid(value_type).name(), DEREFEREE_MAX_SYMBOL_LEN);
+	strncpy(type_name, typeid(value_type).name(),
+		DEREFEREE_MAX_SYMBOL_LEN);
 #endif
 	current_platform()->demangle_type_name(type_name);
 
-	size_t bufsize = strlen(type_name) + 1;
-	addr_info->type_name = (char*)malloc(bufsize);
-#ifdef _MSC_VER
-	strcpy_s(addr_info->type_name, bufsize, type_name);
-#else
-	strcpy(addr_info->type_name, type_name);
-#endif
+	return intern_type_name(type_name);
+}
+
+// ------------------------------------------------------------------
+template <typename T, typename checks>
+void checked_ptr<T, checks>::store_type_info(mem_info* addr_info)
+{
+	// Initialize supplemental information for the memory block that could
+	// not be computed in operator new.
+
+	// The name of each type is demangled and interned only the first time a
+	// block of that type is seen. The initialization of a local static is
+	// thread-safe, so other threads wait for the first one to finish.
+	static const typename_t type_name_id = intern_current_type_name();
+
+	addr_info->type_name = type_name_id;
 
 	addr_info->cookie_size = 0;
 	addr_info->array_size = 0;
 	addr_info->cookie_size_is_known = false;
+
+	if(addr_info->is_array)
+		eager_cookie<value_type>::fill(addr_info);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-void do_relational_check(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+void do_relational_check(const checked_ptr<U, UC>& lhs,
+	const checked_ptr<V, VC>& rhs)
 {
 	pointer_state lhs_state = lhs.state();
 	pointer_state rhs_state = rhs.state();
@@ -983,10 +1133,13 @@ void do_relational_check(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 	{
 		__DMI->error(error_compare_dead_out_of_bounds);
 	}
-	else if(lhs_state == state_dead_deleted ||
-			rhs_state == state_dead_deleted)
+	else if(lhs_state == state_dead_deleted)
 	{
-		__DMI->error(error_compare_dead_deleted);
+		__DMI->deleted_pointer_error(error_compare_dead_deleted, lhs.tag);
+	}
+	else if(rhs_state == state_dead_deleted)
+	{
+		__DMI->deleted_pointer_error(error_compare_dead_deleted, rhs.tag);
 	}
 	else if(lhs_state == state_dead_uninitialized ||
 			rhs_state == state_dead_uninitialized)
@@ -996,12 +1149,13 @@ void do_relational_check(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
 	else if((lhs.pointer == NULL && rhs.pointer != NULL) ||
 			(lhs.pointer != NULL && rhs.pointer == NULL))
 	{
-		__DMI->error(error_inequality_one_side_null);
+		if(UC::check_null || VC::check_null)
+			__DMI->error(error_inequality_one_side_null);
 	}
-	else
+	else if(UC::check_bounds || VC::check_bounds)
 	{
-		const mem_info* lhs_info = __DMI->address_info(lhs.pointer);
-		const mem_info* rhs_info = __DMI->address_info(rhs.pointer);
+		const mem_info* lhs_info = lhs.block_info();
+		const mem_info* rhs_info = rhs.block_info();
 		
 		if(lhs_info != rhs_info)
 		{
@@ -25,6 +25,7 @@
 #include <dereferee/types.h>
 #include <dereferee/manager.h>
 #include <dereferee/pointer_traits.h>
+#include <dereferee/check_level.h>
 
 namespace Dereferee
 {
@@ -37,6 +38,8 @@ template <typename U> class dynamic_cast_helper;
 template <typename U> class const_cast_helper;
 #endif
 
+template <typename T> class checked_range;
+
 
 // ===========================================================================
 /**
@@ -78,8 +81,12 @@ enum pointer_state
  * For any pointer type T*, checked_ptr<T*> can be used as a drop-in
  * replacement. Only the declaration of the pointer variable needs to be
  * changed; no other syntactic modifications have to be made in source code.
+ *
+ * The optional second template parameter is a policy, such as check_level<N>
+ * (see check_level.h), that selects at compile time which checks are
+ * performed. Checks that are left out cost nothing at runtime.
  */
-template <typename T>
+template <typename T, typename checks = default_checks>
 class checked_ptr
 {
 private:
@@ -115,6 +122,96 @@ private:
 	 */
 	bool out_of_bounds;
 
+#ifdef DEREFEREE_CACHED_INFO
+	// -----------------------------------------------------------------------
+	/**
+	 * A handle to the information about the memory block that this pointer
+	 * was last found to point into, or NULL. The handle is only trusted after
+	 * the memory manager has confirmed that it still describes a live checked
+	 * block with this pointer's tag that contains this pointer's address;
+	 * otherwise the memory table is searched and the handle is refreshed.
+	 * This saves a search of the table for most pointer operations.
+	 */
+	mutable mem_info* cached_info;
+#endif
+
+#ifdef DEREFEREE_FAT_POINTERS
+	// -----------------------------------------------------------------------
+	/**
+	 * The address of the first element of the block that this pointer
+	 * points into, and the address one past its end, or NULL if they have
+	 * not yet been needed. They are copied from the block with this
+	 * pointer's tag the first time the pointer is moved, and are copied
+	 * along with the tag, so they describe the right block for as long as
+	 * the tag does. Pointer arithmetic is checked against them without
+	 * consulting the memory manager.
+	 */
+	mutable const char* lower_bound;
+	mutable const char* upper_bound;
+#endif
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the information about the live checked block that this pointer
+	 * points into, or NULL if the pointer is not alive. With
+	 * DEREFEREE_CACHED_INFO, the cached handle is tried first and refreshed
+	 * if necessary.
+	 */
+	mem_info* live_info() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the information about the memory block that contains the
+	 * address held by this pointer, whether or not the pointer is alive, or
+	 * NULL if no allocated block contains it.
+	 */
+	mem_info* block_info() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Records the block that the address just stored in this pointer points
+	 * into: its tag, a handle to its information, and a reference to it.
+	 * This is used when a checked pointer is given a raw address, such as
+	 * the result of new, and reports an error if the address does not belong
+	 * to an allocated block.
+	 */
+	void attach();
+
+#ifdef DEREFEREE_MOVE_SEMANTICS
+	// -----------------------------------------------------------------------
+	/**
+	 * Makes this pointer null without releasing its reference to its block.
+	 * This is used on a pointer that has just been moved from, after its
+	 * reference has been handed over to another pointer.
+	 */
+	void release();
+#endif
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Moves this pointer to the specified address as the result of pointer
+	 * arithmetic, and reports an error if the new address lies outside the
+	 * block that the pointer pointed into.
+	 */
+	void move_to(pointer_type new_pointer);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a copy of this pointer moved delta elements. This is used by
+	 * operator+ when bounds are not checked, or once the bounds that the
+	 * pointer carries are known.
+	 */
+	checked_ptr<T, checks> moved_copy(ptrdiff_t delta) const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a pointer to the address delta elements from this one, looked
+	 * up in the memory table. This is used by operator+, and reports an
+	 * error if the new address lies outside the block that this pointer
+	 * points into.
+	 */
+	checked_ptr<T, checks> located_copy(ptrdiff_t delta) const;
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Returns an enumeration value that describes the state of this pointer;
@@ -134,14 +231,30 @@ private:
 	 */
 	void store_type_info(mem_info* addr_info);
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Demangles the name of the type that this pointer points to and
+	 * interns it.
+	 *
+	 * @returns the identifier of the interned type name
+	 */
+	static typename_t intern_current_type_name();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Ranges check the whole of a run of elements when they are created.
+	 */
+	template <typename U>
+	friend class checked_range;
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Performs a set of sanity checks used by the relational operators:
 	 * <, <=, >, and >=.
 	 */
-	template <typename U, typename V>
-	friend void do_relational_check(const checked_ptr<U>& lhs,
-									const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend void do_relational_check(const checked_ptr<U, UC>& lhs,
+									const checked_ptr<V, VC>& rhs);
 
 public:
 	// -----------------------------------------------------------------------
@@ -159,7 +272,21 @@ public:
 	 * 
 	 * @param rhs The checked pointer being aliased.
 	 */
-	checked_ptr(const checked_ptr<T>& rhs);
+	checked_ptr(const checked_ptr<T, checks>& rhs);
+
+#ifdef DEREFEREE_MOVE_SEMANTICS
+	// -----------------------------------------------------------------------
+	/**
+	 * Creates a checked pointer that takes over the address, state, and
+	 * reference of an existing checked pointer, which is left null. This
+	 * does not consult the memory manager, and a dead pointer is moved
+	 * without an error; the error is reported when it is next used. It is
+	 * noexcept so that std::vector moves its elements when it grows.
+	 *
+	 * @param rhs The checked pointer being moved from.
+	 */
+	checked_ptr(checked_ptr<T, checks>&& rhs) noexcept;
+#endif
 
 	// -----------------------------------------------------------------------
 	/**
@@ -241,7 +368,22 @@ public:
 	 * @param rhs The checked pointer being aliased.
 	 * @returns a reference to this pointer
 	 */
-	checked_ptr<T>& operator=(const checked_ptr<T>& rhs);
+	checked_ptr<T, checks>& operator=(const checked_ptr<T, checks>& rhs);
+
+#ifdef DEREFEREE_MOVE_SEMANTICS
+	// -----------------------------------------------------------------------
+	/**
+	 * Sets the current checked pointer to take over the address, state, and
+	 * reference of an existing checked pointer, which is left null. If the
+	 * current pointer is not dead, a memory leak warning will be generated
+	 * if it is the last reference to a particular memory block; otherwise
+	 * the memory manager is not consulted.
+	 *
+	 * @param rhs The checked pointer being moved from.
+	 * @returns a reference to this pointer
+	 */
+	checked_ptr<T, checks>& operator=(checked_ptr<T, checks>&& rhs);
+#endif
 
 #ifndef DEREFEREE_NO_DYNAMIC_CAST
 	// -----------------------------------------------------------------------
@@ -254,7 +396,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const dynamic_cast_helper<U*>& rhs);
+	checked_ptr<T, checks>& operator=(const dynamic_cast_helper<U*>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -266,7 +408,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const dynamic_cast_helper<U* const>& rhs);
+	checked_ptr<T, checks>& operator=(const dynamic_cast_helper<U* const>& rhs);
 #endif
 
 #ifndef DEREFEREE_NO_CONST_CAST
@@ -280,7 +422,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const const_cast_helper<U*>& rhs);
+	checked_ptr<T, checks>& operator=(const const_cast_helper<U*>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -292,7 +434,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const const_cast_helper<U* const>& rhs);
+	checked_ptr<T, checks>& operator=(const const_cast_helper<U* const>& rhs);
 #endif
 
 	// -----------------------------------------------------------------------
@@ -305,9 +447,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator==(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator==(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -320,9 +462,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator!=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator!=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -336,9 +478,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator<(const checked_ptr<U>& lhs,
-						  const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator<(const checked_ptr<U, UC>& lhs,
+						  const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -352,9 +494,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator<=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator<=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -368,9 +510,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator>(const checked_ptr<U>& lhs,
-						  const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator>(const checked_ptr<U, UC>& lhs,
+						  const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -384,9 +526,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator>=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator>=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -394,7 +536,7 @@ public:
 	 *
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator++();
+	checked_ptr<T, checks>& operator++();
 
 	// -----------------------------------------------------------------------
 	/**
@@ -403,7 +545,7 @@ public:
 	 * @returns a pointer that points to the original value before this
 	 *     pointer was incremented
 	 */
-	checked_ptr<T> operator++(int);
+	checked_ptr<T, checks> operator++(int);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -411,7 +553,7 @@ public:
 	 *
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator--();
+	checked_ptr<T, checks>& operator--();
 	
 	// -----------------------------------------------------------------------
 	/**
@@ -420,7 +562,7 @@ public:
 	 * @returns a pointer that points to the original value before this
 	 *     pointer was decremented
 	 */
-	checked_ptr<T> operator--(int);
+	checked_ptr<T, checks> operator--(int);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -431,8 +573,8 @@ public:
 	 * @param delta the number of elements to advance
 	 * @returns a pointer that points to memory delta elements after ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator+(const checked_ptr<U>& ptr,
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator+(const checked_ptr<U, UC>& ptr,
 									ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
@@ -444,9 +586,9 @@ public:
 	 * @param ptr the pointer to advance from
 	 * @returns a pointer that points to memory delta elements after ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator+(ptrdiff_t delta,
-									const checked_ptr<U>& ptr);
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator+(ptrdiff_t delta,
+									const checked_ptr<U, UC>& ptr);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -456,8 +598,8 @@ public:
 	 * @param delta the number of elements to move back
 	 * @returns a pointer that points to memory delta elements before ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator-(const checked_ptr<U>& ptr,
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator-(const checked_ptr<U, UC>& ptr,
 									ptrdiff_t delta);
 	
 	// -----------------------------------------------------------------------
@@ -469,9 +611,9 @@ public:
 	 * @returns a ptrdiff_t value that indicates the distance between the two
 	 *     pointers
 	 */
-	template <typename U, typename V>
-	friend ptrdiff_t operator-(const checked_ptr<U>& lhs,
-							   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend ptrdiff_t operator-(const checked_ptr<U, UC>& lhs,
+							   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -480,7 +622,7 @@ public:
 	 * @param delta the number of elements to advance
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator+=(ptrdiff_t delta);
+	checked_ptr<T, checks>& operator+=(ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -489,7 +631,7 @@ public:
 	 * @param delta the number of elements to move back
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator-=(ptrdiff_t delta);
+	checked_ptr<T, checks>& operator-=(ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -533,8 +675,8 @@ public:
 	 * @returns a checked pointer of type checked(U*) that points to the same
 	 *     address as this pointer.
 	 */
-	template <typename U>
-	operator checked_ptr<U>() const;
+	template <typename U, typename UC>
+	operator checked_ptr<U, UC>() const;
 
 	// -----------------------------------------------------------------------
 	/**
@@ -573,4 +715,10 @@ public:
 #include <dereferee/checked-impl.h>
 
 
+/*
+ * Include the checked_range view of the elements of an array.
+ */
+#include <dereferee/checked_range.h>
+
+
 #endif // DEREFEREE_CHECKED_H
@@ -0,0 +1,256 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_CHECKED_RANGE_H
+#define DEREFEREE_CHECKED_RANGE_H
+
+#define __DMI Dereferee::manager::instance()
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/**
+ * checked_range is a view of a run of consecutive elements of an array that
+ * a checked pointer points into. The whole run is checked once, when the
+ * range is created, in the same way that operator[] checks a single element;
+ * after that, the elements are accessed through raw pointers, so a loop over
+ * the range runs as fast as one over a raw array:
+ *
+ *     checked(int*) values = new int[n];
+ *     ...
+ *     for(int& value : Dereferee::checked_range<int*>(values, n))
+ *         sum += value;
+ *
+ * Because nothing is checked after the range has been created, it should
+ * only be used where the array is known not to be deleted while the range is
+ * in use, such as in instructor-provided helper code and test assertions.
+ *
+ * The type parameter T is the pointer type, as it is for checked_ptr.
+ */
+template <typename T>
+class checked_range
+{
+private:
+	/* These are absorbed into the checked_range class for brevity
+	   elsewhere. */
+	typedef typename pointer_traits<T>::value_type value_type;
+	typedef typename pointer_traits<T>::reference_type reference_type;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * The address of the first element in the range.
+	 */
+	value_type* first;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * The number of elements in the range.
+	 */
+	size_t count;
+
+public:
+	/**
+	 * The type of iterator used to traverse the range.
+	 */
+	typedef value_type* iterator;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Creates a range of the specified number of elements starting at the
+	 * address held by a checked pointer. An error is reported if the
+	 * pointer is dead, if it does not point into an array, or if the array
+	 * ends before the range does.
+	 *
+	 * @param ptr a pointer to the first element in the range
+	 * @param length the number of elements in the range
+	 */
+	template <typename checks>
+	checked_range(const checked_ptr<T, checks>& ptr, size_t length);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Creates a range of the specified number of elements starting at a raw
+	 * address. Nothing is checked; this allows code that uses ranges to be
+	 * compiled with DEREFEREE_DISABLED, where checked(T*) is simply T*.
+	 *
+	 * @param ptr a pointer to the first element in the range
+	 * @param length the number of elements in the range
+	 */
+	checked_range(value_type* ptr, size_t length) :
+		first(ptr), count(length) { }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns an iterator that points to the first element in the range.
+	 */
+	iterator begin() const { return first; }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns an iterator that points one past the last element in the
+	 * range.
+	 */
+	iterator end() const { return first + count; }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the address of the first element in the range, as a raw
+	 * pointer that can be passed to functions such as memcmp.
+	 */
+	value_type* data() const { return first; }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the number of elements in the range.
+	 */
+	size_t size() const { return count; }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Accesses an element of the range, without checking the index.
+	 *
+	 * @param index the index of the element, relative to the start of the
+	 *     range
+	 * @returns a reference to the element
+	 */
+	reference_type operator[](size_t index) const { return first[index]; }
+};
+
+
+// ---------------------------------------------------------------------------
+/**
+ * Creates a checked_range of the specified number of elements starting at
+ * the address held by a checked pointer, deducing the pointer type.
+ *
+ * @param ptr a pointer to the first element in the range
+ * @param length the number of elements in the range
+ * @returns the range
+ */
+template <typename T, typename checks>
+inline checked_range<T> make_checked_range(const checked_ptr<T, checks>& ptr,
+	size_t length)
+{
+	return checked_range<T>(ptr, length);
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * Creates a checked_range of the specified number of elements starting at a
+ * raw address, without checking it (see the corresponding constructor).
+ *
+ * @param ptr a pointer to the first element in the range
+ * @param length the number of elements in the range
+ * @returns the range
+ */
+template <typename T>
+inline checked_range<T*> make_checked_range(T* ptr, size_t length)
+{
+	return checked_range<T*>(ptr, length);
+}
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::checked_range methods.
+ */
+
+// ------------------------------------------------------------------
+template <typename T>
+template <typename checks>
+checked_range<T>::checked_range(const checked_ptr<T, checks>& ptr,
+	size_t length) :
+	first(ptr.pointer),
+	count(length)
+{
+	switch(ptr.state())
+	{
+	case state_alive:
+		break;
+
+	case state_null:
+		if(checks::check_null && length > 0)
+			__DMI->error(error_deref_null_index_op);
+		return;
+
+	case state_dead_uninitialized:
+		__DMI->error(error_deref_uninitialized_index_op);
+		return;
+
+	case state_dead_deleted:
+		__DMI->deleted_pointer_error(error_deref_deleted_index_op, ptr.tag);
+		return;
+
+	case state_dead_out_of_bounds:
+		__DMI->error(error_deref_out_of_bounds_index_op);
+		return;
+	}
+
+	if(!checks::check_bounds || length == 0)
+		return;
+
+	mem_info* addr_info = ptr.block_info();
+
+	if(addr_info)
+	{
+		if(!addr_info->is_array)
+		{
+			__DMI->error(error_index_non_array);
+		}
+		else
+		{
+			// The number of elements left in the array is compared, rather
+			// than the address of the end of the range, so that a very large
+			// length cannot wrap around the address space. Indices in errors
+			// are relative to the start of the array.
+
+			calculating_bounds_checker<value_type> checker(addr_info);
+			const char* start = (const char*)first;
+			size_t size = addr_info->array_size;
+			ptrdiff_t offset = (start - checker.lower_bound())
+				/ (ptrdiff_t)sizeof(value_type);
+
+			if(start < checker.lower_bound() || start > checker.upper_bound())
+			{
+				__DMI->error(error_index_out_of_bounds, (int)offset,
+					size - 1);
+			}
+			else
+			{
+				size_t available = (checker.upper_bound() - start)
+					/ sizeof(value_type);
+
+				if(length > available)
+				{
+					__DMI->error(error_index_out_of_bounds,
+						(int)(offset + length - 1), size - 1);
+				}
+			}
+		}
+	}
+
+	// Post error behavior: The range still covers the elements that were
+	// asked for. As with operator[], there is nothing else we can do, so let
+	// the unrecoverable error occur when they are accessed.
+}
+
+} // namespace Dereferee
+
+#undef __DMI
+
+#endif // DEREFEREE_CHECKED_RANGE_H
@@ -76,6 +76,60 @@
  *
  * Which strtok function does this compiler support?  On Unix, Mac OS X, and
  * Cygwin, we use strtok_r. On Microsoft Visual C++, we use strtok_s.
+ *
+ * ----
+ * DEREFEREE_THREAD_SAFE
+ * Value: defined/undefined
+ *
+ * Does the compiler provide the C++11 threading library (<atomic>, <mutex>,
+ * and thread_local)? If so, the memory manager protects its tables with
+ * locks and can be used from multiple threads. Define DEREFEREE_NO_THREADS
+ * to leave the locks out on a single-threaded program.
+ *
+ * ----
+ * DEREFEREE_MOVE_SEMANTICS
+ * Value: defined/undefined
+ *
+ * Does the compiler support rvalue references and noexcept? If so, checked
+ * pointers have a move constructor and move assignment operator, so that a
+ * pointer that is returned from a function or moved within a container hands
+ * over its reference to its block without going through the memory manager.
+ *
+ * ----
+ * DEREFEREE_STATIC_COOKIES
+ * Value: defined/undefined
+ *
+ * Does the compiler lay out array cookies according to the generic Itanium
+ * C++ ABI, and support decltype? If so, cookie sizes are computed at compile
+ * time from the element type (see cookie_calculator.h) instead of with a
+ * trial allocation. The ARM variants of the ABI use a different cookie, so
+ * they are left out. Define DEREFEREE_NO_STATIC_COOKIES to always use the
+ * trial allocation.
+ *
+ * ----
+ * DEREFEREE_FAT_POINTERS
+ * Value: defined/undefined
+ *
+ * This is a choice rather than a compiler feature, so it is never defined
+ * below; define it on the command line to enable it. When it is defined,
+ * each checked pointer also carries the bounds of the block that it points
+ * into, so that pointer arithmetic is checked with two comparisons instead
+ * of a call into the memory manager. This makes each checked pointer two
+ * words larger, and arithmetic on a pointer whose block has been deleted is
+ * no longer reported until the pointer is used. Every file in a program
+ * must be compiled with the same setting.
+ *
+ * ----
+ * DEREFEREE_CACHED_INFO
+ * Value: defined/undefined
+ *
+ * Like DEREFEREE_FAT_POINTERS, this is a choice that is never defined below.
+ * When it is defined, each checked pointer keeps a handle to the information
+ * about the block that it was last found to point into, so that copying,
+ * assigning, and destroying a live pointer usually skips the search of the
+ * memory table. This makes each checked pointer one word larger, which also
+ * shows up in the memory usage statistics of programs that allocate checked
+ * pointers. Every file in a program must be compiled with the same setting.
  */
 
 
@@ -96,5 +150,27 @@
 #	define _CRT_SECURE_NO_DEPRECATE 1
 #endif
 
+// C++11 and above, on any compiler (Microsoft Visual C++ 2015 is the first
+// version to support thread_local):
+#if(!defined(DEREFEREE_NO_THREADS) && \
+	((__cplusplus >= 201103L && !defined(_MSC_VER)) || \
+	 (defined(_MSC_VER) && _MSC_VER >= 1900)))
+#	define DEREFEREE_THREAD_SAFE
+#endif
+
+// C++11 and above, or Microsoft Visual C++ 2015 and above (which reports an
+// older __cplusplus but supports rvalue references and noexcept):
+#if(__cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900))
+#	define DEREFEREE_MOVE_SEMANTICS
+#endif
+
+// GCC and Clang targets that follow the generic Itanium C++ ABI, in C++11
+// and above:
+#if(defined(__GXX_ABI_VERSION) && __cplusplus >= 201103L && \
+	!defined(__arm__) && !defined(__aarch64__) && \
+	!defined(DEREFEREE_NO_STATIC_COOKIES))
+#	define DEREFEREE_STATIC_COOKIES
+#endif
+
 
 #endif // DEREFEREE_CONFIG_H
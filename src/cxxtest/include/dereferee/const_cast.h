@@ -101,8 +101,8 @@ public:
 	 *
 	 * @param value_to_cast the pointer to cast to U*
 	 */
-	template <typename T>
-	const_cast_helper(const checked_ptr<T*>& value_to_cast) :
+	template <typename T, typename checks>
+	const_cast_helper(const checked_ptr<T*, checks>& value_to_cast) :
 		cast_value(const_cast<U*>((T*)value_to_cast))
 	{
 	}
@@ -158,8 +158,8 @@ public:
 	 *
 	 * @param value_to_cast the pointer to cast to U*
 	 */
-	template <typename T>
-	const_cast_helper(const checked_ptr<T*>& value_to_cast) :
+	template <typename T, typename checks>
+	const_cast_helper(const checked_ptr<T*, checks>& value_to_cast) :
 		cast_value(const_cast<U* const>((T*)value_to_cast))
 	{
 	}
@@ -20,6 +20,7 @@
 #define DEREFEREE_COOKIE_CALCULATOR_H
 
 #include <cstdlib>
+#include <dereferee/config.h>
 
 namespace Dereferee
 {
@@ -83,6 +84,10 @@ struct cookie_info
  * both of these situations are ill-advised because they do not provide
  * proper polymorphism and would only work properly in the event that the
  * both Base and Derived were the same size in memory.
+ *
+ * Where the cookie size can be computed at compile time (see static_cookie
+ * below), none of the above applies and this implementation is only used
+ * as a fallback for classes that declare their own sized operator delete[].
  */
 
 // ===========================================================================
@@ -152,13 +157,107 @@ public:
 
 // ===========================================================================
 /**
- * "Public" interface for the cookie calculator, used by the other Dereferee
- * classes. This class delegates to one of the compiler-specific
- * cookie_calculator_impl classes defined above.
+ * Computes the size of the cookie for arrays of type T[] at compile time,
+ * following the rules of the Itanium C++ ABI: an array has a cookie if its
+ * element type has a non-trivial destructor, or if the deallocation function
+ * for the array takes the size of the block as a second argument. The
+ * cookie holds the number of elements, and is padded out to the alignment
+ * of the element type.
+ *
+ * The size argument cannot be detected reliably when a class declares both
+ * forms of operator delete[], so for any class that declares the sized form,
+ * is_known is false and the trial allocation above is used instead. It is
+ * also false for void, and on compilers that do not follow the generic ABI
+ * (see DEREFEREE_STATIC_COOKIES in config.h).
  */
+#ifdef DEREFEREE_STATIC_COOKIES
+
 template <typename T>
+struct has_sized_array_delete
+{
+	template <typename U>
+	static char test(decltype(U::operator delete[]((void*)0, (size_t)0))*);
+
+	template <typename U>
+	static long test(...);
+
+	static const bool value = (sizeof(test<T>(0)) == sizeof(char));
+};
+
+template <typename T>
+struct static_cookie
+{
+	typedef typename remove_const<T>::type type;
+
+#ifdef __clang__
+	static const bool has_trivial_destructor =
+		__is_trivially_destructible(type);
+#else
+	static const bool has_trivial_destructor =
+		__has_trivial_destructor(type);
+#endif
+
+	static const bool is_known = !has_sized_array_delete<type>::value;
+
+	static const size_t size = has_trivial_destructor ? 0 :
+		(__alignof__(type) > sizeof(size_t) ?
+			__alignof__(type) : sizeof(size_t));
+};
+
+#else
+
+template <typename T>
+struct static_cookie
+{
+	static const bool is_known = false;
+	static const size_t size = 0;
+};
+
+#endif // DEREFEREE_STATIC_COOKIES
+
+template <>
+struct static_cookie<void>
+{
+	static const bool is_known = false;
+	static const size_t size = 0;
+};
+
+template <>
+struct static_cookie<const void>
+{
+	static const bool is_known = false;
+	static const size_t size = 0;
+};
+
+
+// ===========================================================================
+/**
+ * "Public" interface for the cookie calculator, used by the other Dereferee
+ * classes. When the cookie size for T[] is known at compile time, it is
+ * returned directly; otherwise, this class delegates to one of the
+ * compiler-specific cookie_calculator_impl classes defined above, once per
+ * type.
+ */
+template <typename T, bool is_static = static_cookie<T>::is_known>
 class cookie_calculator
 {
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the size of the cookie allocated at the front of arrays of type
+	 * T[].
+	 *
+	 * @returns the size of the cookie
+	 */
+	static size_t size()
+	{
+		return static_cookie<T>::size;
+	}
+};
+
+template <typename T>
+class cookie_calculator<T, false>
+{
 private:
 	/**
 	 * Initially false, this is set to true once the cookie size for arrays of
@@ -192,10 +291,10 @@ public:
 };
 
 template <typename T>
-bool cookie_calculator<T>::_cookie_size_is_known = false;
+bool cookie_calculator<T, false>::_cookie_size_is_known = false;
 
 template <typename T>
-size_t cookie_calculator<T>::_cached_cookie_size = 0;
+size_t cookie_calculator<T, false>::_cached_cookie_size = 0;
 
 } // end namespace Dereferee
 
@@ -41,6 +41,19 @@
  * - "max.leaks.to.report": if set, the integer value of this variable
  *   will be used to specify the maximum number of memory leaks that should be
  *   reported at the end of execution.
+ * - "quarantine.size": if set, the integer value of this variable will be
+ *   used to specify the number of deleted blocks of memory that are held out
+ *   of circulation, so that errors involving dangling pointers to them can
+ *   also report where they were allocated. The default is 0 (no quarantine).
+ * - "group.leaks": if set to "true", leaked blocks that were allocated at the
+ *   same place are reported together, with a count, instead of one at a
+ *   time; "max.leaks.to.report" then limits the number of places reported.
+ * - "raw.backtraces": if set to "true", backtraces are printed as raw
+ *   addresses instead of function names and source locations, so the
+ *   platform never has to load the executable's symbol table. If
+ *   "webcat.stats.path" is also set, the load address of the executable and
+ *   each backtrace are written to that file as comments, so that they can be
+ *   symbolized later by another tool.
  */
 
 // ===========================================================================
@@ -99,7 +112,8 @@ static const char* warning_messages[] =
 {
 	"Memory leak caused by last live pointer to memory block going out of scope",
 	"Memory leak caused by last live pointer to memory block being overwritten",
-	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic"
+	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic",
+	"Signal-protected regions are nested %d levels deep and there is no memory left to save another backtrace context, so backtraces may be wrong until some of them are left"
 };
 
 // ===========================================================================
@@ -128,6 +142,14 @@ private:
 
 	size_t max_leaks;
 
+	size_t quarantine_blocks;
+
+	bool group_leaks;
+
+	bool raw_backtraces;
+
+	void** deleted_backtrace;
+
 	FILE* stream;
 	
 	FILE* webcat_file;
@@ -143,6 +165,13 @@ private:
 	// -----------------------------------------------------------------------
 	void print_backtrace(void** backtrace, const char* label);
 
+	// -----------------------------------------------------------------------
+	void print_raw_backtrace(void** backtrace, const char* label);
+
+	// -----------------------------------------------------------------------
+	void describe_allocation_site(void** backtrace, char* buffer,
+		size_t size);
+
 public:
 	// -----------------------------------------------------------------------
 	cxxtest_listener(const Dereferee::option* options,
@@ -154,6 +183,9 @@ public:
 	// -----------------------------------------------------------------------
 	size_t maximum_leaks_to_report();
 
+	// -----------------------------------------------------------------------
+	size_t quarantine_size();
+
 	// -----------------------------------------------------------------------
     void* get_allocation_user_info(
         const Dereferee::allocation_info& alloc_info);
@@ -166,6 +198,16 @@ public:
 
 	// -----------------------------------------------------------------------
 	void report_leak(const Dereferee::allocation_info& leak);
+
+	// -----------------------------------------------------------------------
+	bool group_leaks_by_site();
+
+	// -----------------------------------------------------------------------
+	void report_leak_site(const Dereferee::allocation_info& leak,
+		size_t count);
+
+	// -----------------------------------------------------------------------
+	bool symbolizes_backtraces();
 	
 	// -----------------------------------------------------------------------
 	void report_truncated(size_t reports_logged,
@@ -174,6 +216,9 @@ public:
 	// -----------------------------------------------------------------------
 	void end_report();
 	
+	// -----------------------------------------------------------------------
+	void describe_deleted_block(const Dereferee::allocation_info& block);
+
 	// -----------------------------------------------------------------------
 	void error(Dereferee::error_code code, va_list args);
 
@@ -191,6 +236,10 @@ cxxtest_listener::cxxtest_listener(const Dereferee::option* options,
 	stream = stdout;
 	prefix_string = NULL;
 	max_leaks = UINT_MAX;
+	quarantine_blocks = 0;
+	group_leaks = false;
+	raw_backtraces = false;
+	deleted_backtrace = NULL;
 	webcat_file = NULL;
 
 	while(options->key != NULL)
@@ -217,10 +266,28 @@ cxxtest_listener::cxxtest_listener(const Dereferee::option* options,
 		{
 			max_leaks = atoi(options->value);
 		}
+		else if(strcmp(options->key, "quarantine.size") == 0)
+		{
+			quarantine_blocks = atoi(options->value);
+		}
+		else if(strcmp(options->key, "group.leaks") == 0)
+		{
+			group_leaks = (strcmp(options->value, "true") == 0);
+		}
+		else if(strcmp(options->key, "raw.backtraces") == 0)
+		{
+			raw_backtraces = (strcmp(options->value, "true") == 0);
+		}
 		
 		options++;
 	}
 
+	if(raw_backtraces && webcat_file)
+	{
+		fprintf(webcat_file, "# dereferee.load.address %p\n",
+				platform->get_load_address());
+	}
+
 	setvbuf(stream, NULL, _IONBF, 0);
 }
 
@@ -240,6 +307,12 @@ size_t cxxtest_listener::maximum_leaks_to_report()
 	return max_leaks;
 }
 
+// ------------------------------------------------------------------
+size_t cxxtest_listener::quarantine_size()
+{
+	return quarantine_blocks;
+}
+
 // ------------------------------------------------------------------
 void* cxxtest_listener::get_allocation_user_info(
     const Dereferee::allocation_info& /* alloc_info */)
@@ -313,6 +386,31 @@ void cxxtest_listener::report_leak(const Dereferee::allocation_info& leak)
 	prefix_printf("\n");
 }		
 
+// ------------------------------------------------------------------
+bool cxxtest_listener::group_leaks_by_site()
+{
+	return group_leaks;
+}
+
+// ------------------------------------------------------------------
+void cxxtest_listener::report_leak_site(
+	const Dereferee::allocation_info& leak, size_t count)
+{
+	if(count > 1)
+	{
+		prefix_printf("%zu leaks from the same allocation site, such as:\n",
+			count);
+	}
+
+	report_leak(leak);
+}
+
+// ------------------------------------------------------------------
+bool cxxtest_listener::symbolizes_backtraces()
+{
+	return !raw_backtraces;
+}
+
 // ------------------------------------------------------------------
 void cxxtest_listener::report_truncated(size_t reports_logged,
 		size_t actual_leaks)
@@ -363,11 +461,27 @@ void cxxtest_listener::end_report()
 	}
 }
 
+// ------------------------------------------------------------------
+void cxxtest_listener::describe_deleted_block(
+	const Dereferee::allocation_info& block)
+{
+	// The backtrace belongs to the quarantined block, so it is still valid
+	// when error() is called immediately afterward.
+	deleted_backtrace = block.backtrace();
+}
+
 // ------------------------------------------------------------------
 void cxxtest_listener::error(Dereferee::error_code code, va_list args)
 {
 	char text[513];
 	vsprintf(text, error_messages[code], args);
+
+	if(deleted_backtrace)
+	{
+		describe_allocation_site(deleted_backtrace,
+			text + strlen(text), sizeof(text) - strlen(text));
+		deleted_backtrace = NULL;
+	}
 	
 	if (prefix_string)
         CxxTest::__cxxtest_assertmsg =
@@ -444,6 +558,12 @@ void cxxtest_listener::print_backtrace(void** backtrace, const char* label)
 	if(backtrace == NULL)
 		return;
 
+	if(raw_backtraces)
+	{
+		print_raw_backtrace(backtrace, label);
+		return;
+	}
+
 	bool first = true;
 
 	char function[DEREFEREE_MAX_FUNCTION_LEN] = { 0 };
@@ -478,6 +598,64 @@ void cxxtest_listener::print_backtrace(void** backtrace, const char* label)
 	}
 }
 
+// ------------------------------------------------------------------
+void cxxtest_listener::print_raw_backtrace(void** backtrace,
+	const char* label)
+{
+	// Without symbols, frames inside Dereferee and CxxTest cannot be told
+	// apart from the user's, so every frame is printed.
+
+	prefix_printf("%14s:", label);
+
+	if(webcat_file)
+		fprintf(webcat_file, "# dereferee.backtrace");
+
+	for(; *backtrace; backtrace++)
+	{
+		fprintf(stream, " %p", *backtrace);
+
+		if(webcat_file)
+			fprintf(webcat_file, " %p", *backtrace);
+	}
+
+	fprintf(stream, "\n");
+
+	if(webcat_file)
+		fprintf(webcat_file, "\n");
+}
+
+// ------------------------------------------------------------------
+void cxxtest_listener::describe_allocation_site(void** backtrace,
+	char* buffer, size_t size)
+{
+	// The allocation site is named by its innermost user frame, which can
+	// only be found with symbols.
+	if(raw_backtraces)
+		return;
+
+	char function[DEREFEREE_MAX_FUNCTION_LEN] = { 0 };
+	char filename[DEREFEREE_MAX_FILENAME_LEN] = { 0 };
+	int line = 0;
+
+	// Name the innermost frame that is part of the user's code.
+	for(; *backtrace; backtrace++)
+	{
+		if(platform->get_backtrace_frame_info(*backtrace,
+			function, filename, &line)
+			&& CxxTest::filter_backtrace_frame(function))
+		{
+			if(line)
+				snprintf(buffer, size, " (memory was allocated in %s at "
+					"%s:%d)", function, filename, line);
+			else
+				snprintf(buffer, size, " (memory was allocated in %s)",
+					function);
+
+			return;
+		}
+	}
+}
+
 } // end namespace DerefereeSupport
 
 // ===========================================================================
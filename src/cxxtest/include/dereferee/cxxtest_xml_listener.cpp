@@ -97,7 +97,8 @@ static const char* warning_messages[] =
 {
 	"Memory leak caused by last live pointer to memory block going out of scope",
 	"Memory leak caused by last live pointer to memory block being overwritten",
-	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic"
+	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic",
+	"Signal-protected regions are nested %d levels deep and there is no memory left to save another backtrace context, so backtraces may be wrong until some of them are left"
 };
 
 // ===========================================================================
@@ -101,8 +101,8 @@ public:
 	 *
 	 * @param value_to_cast the pointer to cast to U*
 	 */
-	template <typename T>
-	dynamic_cast_helper(const checked_ptr<T*>& value_to_cast) :
+	template <typename T, typename checks>
+	dynamic_cast_helper(const checked_ptr<T*, checks>& value_to_cast) :
 		cast_value(dynamic_cast<U*>((T*)value_to_cast))
 	{
 	}
@@ -158,8 +158,8 @@ public:
 	 *
 	 * @param value_to_cast the pointer to cast to U*
 	 */
-	template <typename T>
-	dynamic_cast_helper(const checked_ptr<T*>& value_to_cast) :
+	template <typename T, typename checks>
+	dynamic_cast_helper(const checked_ptr<T*, checks>& value_to_cast) :
 		cast_value(dynamic_cast<U* const>((T*)value_to_cast))
 	{
 	}
@@ -21,8 +21,16 @@
 #include <cstdarg>
 #include <cstring>
 #include <unistd.h>
+#ifndef __CYGWIN__
+#include <link.h>
+#endif
 #include <bfd.h>
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+#include <unwind.h>
+#endif
 #include <dereferee/platform.h>
+#include <dereferee/listener.h>
+#include <dereferee/threads.h>
 
 
 // ===========================================================================
@@ -33,11 +41,35 @@
  * current executable reliably at runtime (to my knowledge, this includes
  * Cygwin and most BSD and Linux distributions).
  *
+ * The symbol table is not loaded until the first time a backtrace frame is
+ * symbolized, so a program that never reports an error or a leak does not
+ * pay to read it.
+ *
+ * To affect runtime behavior, the following options can be used:
+ *
+ * - "backtrace.depth": if set, the integer value of this variable will be
+ *   used to limit the number of frames captured in each allocation's
+ *   backtrace, counting from the innermost one (the innermost few belong to
+ *   the memory manager's operator new). The default is 0 (no limit).
+ * - "backtrace.sample.interval": if set to an integer N greater than 1, only
+ *   every Nth allocation captures a full backtrace.
+ * - "backtrace.first.per.site": if set to "true", only the first allocation
+ *   made from each site captures a full backtrace.
+ *
+ * When either of the last two options is used, an allocation that does not
+ * capture a full backtrace records only its SITE_DEPTH innermost frames,
+ * which are enough to reach the place in the program that made it, so that
+ * programs that allocate from deep recursion do not pay for copying the
+ * whole stack on every allocation.
+ *
  * OTHER REQUIREMENTS
  * ------------------
  * To support backtrace collection, you must set the -finstrument-functions
- * flag when compiling. Symbol table access requires that you link to the
- * following libraries: bfd, iberty, intl.
+ * flag when compiling, unless DEREFEREE_UNWIND_BACKTRACES is defined (see
+ * gcc_unwind_platform.cpp), in which case backtraces are captured by
+ * unwinding the stack with _Unwind_Backtrace when they are requested. Symbol
+ * table access requires that you link to the following libraries: bfd,
+ * iberty, intl.
  */
 
 // ===========================================================================
@@ -57,9 +89,21 @@ void __cyg_profile_func_exit(void *this_fn, void *call_site) NO_INSTR;
 namespace DerefereeSupport
 {
 
+struct platform_symbol_info;
+
 extern "C"
 {
 static void find_bfd_address(bfd* abfd, asection* section, void* data) NO_INSTR;
+static int compare_function_entries(const void* lhs, const void* rhs) NO_INSTR;
+static void find_indexed_address(platform_symbol_info* info) NO_INSTR;
+#ifndef __CYGWIN__
+static int find_load_address(struct dl_phdr_info* info, size_t size,
+	void* data) NO_INSTR;
+#endif
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+static _Unwind_Reason_Code collect_frame(struct _Unwind_Context* context,
+	void* data) NO_INSTR;
+#endif
 }
 
 void try_demangle_symbol(const char* mangled, char* demangled, size_t size);
@@ -71,13 +115,67 @@ struct backtrace_frame
 };
 
 static const size_t MAX_BACKTRACE_SIZE = 256;
+
+/**
+ * The number of innermost frames of a backtrace that identify the site of an
+ * allocation. The first few are the frames of the memory manager's operator
+ * new, so this is enough to also reach a few frames of the program.
+ */
+static const size_t SITE_DEPTH = 8;
+
+/**
+ * The number of saved contexts that each shadow stack holds itself. Deeper
+ * ones are kept in chunks of CONTEXT_CHUNK_SIZE drawn from the memory
+ * manager's backtrace pool; the first slot of each chunk links to the chunk
+ * below it. The last chunk to empty is kept as a spare, so that a test that
+ * keeps crossing the same chunk boundary does not draw a new chunk each time.
+ */
 static const size_t MAX_SAVED_CONTEXTS = 64;
+static const size_t CONTEXT_CHUNK_SIZE = 63;
 
-static uint32_t back_trace_index = 0;
-static backtrace_frame back_trace[MAX_BACKTRACE_SIZE];
+/**
+ * The frames of the functions that a thread is executing, as recorded by the
+ * instrumentation hooks, and the depths saved by save_current_context.
+ */
+struct shadow_stack
+{
+	uint32_t index;
+	backtrace_frame frames[MAX_BACKTRACE_SIZE];
+
+	uint32_t saved_top;
+	uint32_t saved_indices[MAX_SAVED_CONTEXTS];
+	void** saved_chunk;
+	void** spare_chunk;
+
+	/* The number of contexts, nested above the saved ones, that could not
+	   be saved because no memory was left for another chunk. */
+	uint32_t unsaved;
+};
 
-static uint32_t saved_back_trace_top = 0;
-static uint32_t saved_back_trace_indices[MAX_SAVED_CONTEXTS];
+/**
+ * Each thread keeps its own shadow stack, so that the backtraces of a program
+ * that starts threads are not mixed together, and so that the hooks on every
+ * function entry and exit of different threads do not write to the same
+ * cache lines. The stack is plain data in thread-local storage, so it is
+ * zero-initialized when a thread starts and needs no constructor, and on
+ * most targets each access is a single instruction. The hooks, get_backtrace,
+ * and the signal handler all run on the thread whose stack they use, so the
+ * stacks of other threads never need to be found.
+ */
+static __thread shadow_stack shadow;
+
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+/**
+ * The frames collected by collect_frame while unwinding the stack.
+ */
+struct unwind_state
+{
+	void** frames;
+	size_t count;
+	size_t capacity;
+	size_t skip;
+};
+#endif
 
 struct platform_symbol_info
 {
@@ -88,6 +186,35 @@ struct platform_symbol_info
 	int found;
 };
 
+/**
+ * An entry in the index of function symbols, which is sorted by address so
+ * that the section containing a frame can be found by binary search instead
+ * of by visiting every section in the executable.
+ */
+struct function_entry
+{
+	bfd_vma address;
+	asection* section;
+};
+
+/**
+ * The number of resolved frames that are remembered. A report that prints
+ * the backtraces of many errors and leaks tends to visit the same few dozen
+ * call sites over and over, so each is only resolved by libbfd once.
+ */
+static const size_t SYMBOL_CACHE_SIZE = 256;
+
+/**
+ * An entry in the cache of resolved frames. An entry whose last_used stamp
+ * is zero is empty; otherwise, the entry with the smallest stamp is the one
+ * that was used least recently, and it is replaced first.
+ */
+struct symbol_cache_entry
+{
+	platform_symbol_info info;
+	uint32_t last_used;
+};
+
 // ===========================================================================
 /**
  * The symbol_table is a singleton that loads and maintains the symbol table
@@ -119,6 +246,35 @@ private:
 	 */
 	void load_symbol_info();
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Builds the sorted index of function symbols from the symbol table that
+	 * was just loaded.
+	 */
+	void build_function_index() NO_INSTR;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the function name, source file, and line number for the specified
+	 * address, from the cache if it has been resolved recently.
+	 *
+	 * @param address the address to resolve
+	 *
+	 * @returns the resolved information; its found field is zero if the
+	 *     address could not be resolved
+	 */
+	const platform_symbol_info* resolve_address(bfd_vma address) NO_INSTR;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the function name, source file, and line number for the address
+	 * in the pc field of the specified structure, filling in the rest of it.
+	 *
+	 * @param info the structure that holds the address and receives the
+	 *     information
+	 */
+	void look_up_address(platform_symbol_info* info) NO_INSTR;
+
 public:
 	// -----------------------------------------------------------------------
 	/**
@@ -175,6 +331,17 @@ public:
 	bfd_vma source_location_at_address(bfd_vma address, const char **path,
 		uint32_t *line) NO_INSTR;
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Resolves a batch of addresses at once, replacing the previous batch.
+	 * Later lookups of these addresses are answered from the batch without
+	 * going through the cache.
+	 *
+	 * @param addresses the addresses, sorted and without duplicates
+	 * @param count the number of addresses
+	 */
+	void prepare_addresses(void** addresses, size_t count) NO_INSTR;
+
 	// -----------------------------------------------------------------------
 	void *operator new(size_t size) NO_INSTR;
 	void operator delete(void* ptr) NO_INSTR;
@@ -187,6 +354,15 @@ static asymbol** syms;
 static unsigned long num_symbols;
 static asymbol** sym_table;
 
+static function_entry* function_index;
+static unsigned long num_functions;
+
+static symbol_cache_entry symbol_cache[SYMBOL_CACHE_SIZE];
+static uint32_t symbol_cache_clock;
+
+static platform_symbol_info* prepared_symbols;
+static size_t num_prepared_symbols;
+
 
 // ===========================================================================
 /**
@@ -194,6 +370,67 @@ static asymbol** sym_table;
  */
 class gcc_bfd_platform : public Dereferee::platform
 {
+private:
+	/**
+	 * The largest number of frames to capture in a backtrace, or 0 for no
+	 * limit.
+	 */
+	size_t max_depth;
+
+	/**
+	 * Full backtraces are captured for every sample_interval-th allocation.
+	 */
+	size_t sample_interval;
+
+	/**
+	 * The number of backtraces that have been requested.
+	 */
+	size_t allocations;
+
+	/**
+	 * True if a full backtrace is captured for the first allocation made
+	 * from each site.
+	 */
+	bool first_per_site;
+
+	/**
+	 * An open-addressed hash set of the sites that have made an allocation,
+	 * each represented by a hash of its innermost frames, used when
+	 * first_per_site is true. Empty slots are zero.
+	 */
+	size_t* seen_sites;
+
+	/**
+	 * The number of slots in seen_sites (always zero or a power of two).
+	 */
+	size_t seen_capacity;
+
+	/**
+	 * The number of sites in seen_sites.
+	 */
+	size_t seen_count;
+
+	/**
+	 * Protects allocations and seen_sites, which are shared by every thread
+	 * that allocates memory.
+	 */
+	Dereferee::mutex sample_lock;
+
+	// -----------------------------------------------------------------------
+	bool wants_full_backtrace(void** site_frames, size_t count);
+
+	// -----------------------------------------------------------------------
+	bool add_seen_site(size_t site);
+
+	// -----------------------------------------------------------------------
+	void warning(Dereferee::warning_code code, ...);
+
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+	// -----------------------------------------------------------------------
+	size_t unwind_frames(void** frames, size_t capacity)
+		__attribute__((noinline));
+#endif
+
 public:
 	// -----------------------------------------------------------------------
 	gcc_bfd_platform(const Dereferee::option* options);
@@ -214,6 +451,12 @@ public:
 	// -----------------------------------------------------------------------
 	void demangle_type_name(char* type_name);
 
+	// -----------------------------------------------------------------------
+	void prepare_backtrace_frames(void** frames, size_t count);
+
+	// -----------------------------------------------------------------------
+	void* get_load_address();
+
 	// -----------------------------------------------------------------------
 	void save_current_context();
 
@@ -224,42 +467,231 @@ public:
 // ---------------------------------------------------------------------------
 gcc_bfd_platform::gcc_bfd_platform(const Dereferee::option* options)
 {
-	// Force the symbol table to be created when the platform is initialized,
-	// if it hasn't been already.
-	symbol_table::instance();
+	// The symbol table is created by get_backtrace_frame_info the first time
+	// that it is needed.
+
+	max_depth = 0;
+	sample_interval = 1;
+	allocations = 0;
+	first_per_site = false;
+	seen_sites = NULL;
+	seen_capacity = 0;
+	seen_count = 0;
+
+	while(options->key != NULL)
+	{
+		if(strcmp(options->key, "backtrace.depth") == 0)
+		{
+			int depth = atoi(options->value);
+			max_depth = (depth > 0) ? depth : 0;
+		}
+		else if(strcmp(options->key, "backtrace.sample.interval") == 0)
+		{
+			int interval = atoi(options->value);
+			sample_interval = (interval > 1) ? interval : 1;
+		}
+		else if(strcmp(options->key, "backtrace.first.per.site") == 0)
+		{
+			first_per_site = (strcmp(options->value, "true") == 0);
+		}
+
+		options++;
+	}
 }
 
 // ---------------------------------------------------------------------------
 gcc_bfd_platform::~gcc_bfd_platform()
 {
+	if(seen_sites)
+		free(seen_sites);
 }
 
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+
 // ------------------------------------------------------------------
 void** gcc_bfd_platform::get_backtrace(void* /* instr_ptr */,
 		void* /* frame_ptr */)
 {
-	if(back_trace_index == 0)
+	size_t depth = MAX_BACKTRACE_SIZE;
+
+	if(max_depth && depth > max_depth)
+		depth = max_depth;
+
+	void* frames[MAX_BACKTRACE_SIZE];
+	size_t count;
+
+	// When only some allocations get a full backtrace, unwind just far
+	// enough to identify the site first, so that the others do not pay for
+	// walking the whole stack.
+	if(depth > SITE_DEPTH && (sample_interval > 1 || first_per_site))
+	{
+		count = unwind_frames(frames, SITE_DEPTH);
+
+		if(count == SITE_DEPTH && wants_full_backtrace(frames, SITE_DEPTH))
+			count = unwind_frames(frames, depth);
+	}
+	else
+	{
+		count = unwind_frames(frames, depth);
+	}
+
+	if(count == 0)
+		return NULL;
+
+	void** bt = Dereferee::allocate_backtrace_array(count + 1);
+	if(!bt)
 		return NULL;
 
-	void** bt = (void**)calloc(back_trace_index + 1, sizeof(void*));
-	int bt_index = 0;
+	memcpy(bt, frames, count * sizeof(void*));
+	bt[count] = NULL;
+	return bt;
+}
 
-	bt[bt_index++] = back_trace[back_trace_index - 1].function;
+// ------------------------------------------------------------------
+size_t gcc_bfd_platform::unwind_frames(void** frames, size_t capacity)
+{
+	// The first frame is this function's own, which the instrumented
+	// backtrace does not include either.
+	unwind_state state;
+	state.frames = frames;
+	state.count = 0;
+	state.capacity = capacity;
+	state.skip = 1;
+
+	_Unwind_Backtrace(&collect_frame, &state);
+	return state.count;
+}
 
-	for(int i = (int)back_trace_index - 1; i >= 1; i--)
+#else
+
+// ------------------------------------------------------------------
+void** gcc_bfd_platform::get_backtrace(void* /* instr_ptr */,
+		void* /* frame_ptr */)
+{
+	if(shadow.index == 0)
+		return NULL;
+
+	// The backtrace is the innermost function followed by the call sites of
+	// the frames that enclose it, so a full one has one entry per frame.
+	size_t depth = shadow.index;
+
+	if(max_depth && depth > max_depth)
+		depth = max_depth;
+
+	if(depth > SITE_DEPTH)
 	{
-		bt[bt_index++] = back_trace[i].call_site;
+		void* site_frames[SITE_DEPTH];
+
+		site_frames[0] = shadow.frames[shadow.index - 1].function;
+
+		for(size_t i = 1; i < SITE_DEPTH; i++)
+			site_frames[i] = shadow.frames[shadow.index - i].call_site;
+
+		if(!wants_full_backtrace(site_frames, SITE_DEPTH))
+			depth = SITE_DEPTH;
+	}
+
+	void** bt = Dereferee::allocate_backtrace_array(depth + 1);
+	if(!bt)
+		return NULL;
+
+	size_t bt_index = 0;
+
+	bt[bt_index++] = shadow.frames[shadow.index - 1].function;
+
+	for(int i = (int)shadow.index - 1; bt_index < depth; i--)
+	{
+		bt[bt_index++] = shadow.frames[i].call_site;
 	}
 
 	bt[bt_index++] = NULL;
 	return bt;
 }
 
+#endif // DEREFEREE_UNWIND_BACKTRACES
+
+// ------------------------------------------------------------------
+bool gcc_bfd_platform::wants_full_backtrace(void** site_frames,
+	size_t count)
+{
+	if(sample_interval == 1 && !first_per_site)
+		return true;
+
+	Dereferee::scoped_lock lock(sample_lock);
+
+	bool sampled =
+		(sample_interval > 1 && allocations++ % sample_interval == 0);
+
+	bool first = false;
+
+	if(first_per_site)
+	{
+		// FNV-1a over the frames. Zero marks an empty slot in the set, so
+		// that hash is moved aside. The site is recorded even when the
+		// allocation is also sampled, so that the next allocation from it
+		// is not mistaken for the first.
+		size_t site = (size_t)2166136261U;
+
+		for(size_t i = 0; i < count; i++)
+			site = (site ^ (size_t)site_frames[i]) * (size_t)16777619U;
+
+		first = add_seen_site(site ? site : 1);
+	}
+
+	return sampled || first;
+}
+
+// ------------------------------------------------------------------
+bool gcc_bfd_platform::add_seen_site(size_t site)
+{
+	// Keep the set at most half full so that probe sequences stay short.
+	if(2 * (seen_count + 1) > seen_capacity)
+	{
+		size_t new_capacity = seen_capacity ? seen_capacity * 2 : 256;
+		size_t* new_sites = (size_t*)calloc(new_capacity, sizeof(size_t));
+
+		// If the set cannot grow, every allocation is treated as the first
+		// from its site, which is what happens without the option.
+		if(!new_sites)
+			return true;
+
+		for(size_t i = 0; i < seen_capacity; i++)
+		{
+			if(seen_sites[i])
+			{
+				size_t j = seen_sites[i] & (new_capacity - 1);
+				while(new_sites[j])
+					j = (j + 1) & (new_capacity - 1);
+
+				new_sites[j] = seen_sites[i];
+			}
+		}
+
+		free(seen_sites);
+		seen_sites = new_sites;
+		seen_capacity = new_capacity;
+	}
+
+	size_t i = site & (seen_capacity - 1);
+
+	while(seen_sites[i])
+	{
+		if(seen_sites[i] == site)
+			return false;
+
+		i = (i + 1) & (seen_capacity - 1);
+	}
+
+	seen_sites[i] = site;
+	seen_count++;
+
+	return true;
+}
+
 // ------------------------------------------------------------------
 void gcc_bfd_platform::free_backtrace(void** backtrace)
 {
-	if(backtrace)
-		free(backtrace);
+	Dereferee::free_backtrace_array(backtrace);
 }
 
 // ------------------------------------------------------------------
@@ -311,30 +743,121 @@ void gcc_bfd_platform::demangle_type_name(char* type_name)
 	}
 }
 
+// ---------------------------------------------------------------------------
+void gcc_bfd_platform::prepare_backtrace_frames(void** frames, size_t count)
+{
+	// libbfd is not thread-safe, so the frames are resolved one after
+	// another; the gain comes from resolving each frame only once, in order
+	// of address, rather than in the order that the report visits them.
+	symbol_table::instance()->prepare_addresses(frames, count);
+}
+
+// ---------------------------------------------------------------------------
+void* gcc_bfd_platform::get_load_address()
+{
+#ifdef __CYGWIN__
+	return NULL;
+#else
+	// The first object visited is the executable itself.
+	void* address = NULL;
+	dl_iterate_phdr(&find_load_address, &address);
+	return address;
+#endif
+}
+
 // ---------------------------------------------------------------------------
 void gcc_bfd_platform::save_current_context()
 {
-	if (saved_back_trace_top > MAX_SAVED_CONTEXTS)
+	if(shadow.unsaved)
 	{
-		exit(1);
+		shadow.unsaved++;
+		return;
 	}
-	else
+
+	if(shadow.saved_top < MAX_SAVED_CONTEXTS)
 	{
-		saved_back_trace_indices[saved_back_trace_top] = back_trace_index;
-		saved_back_trace_top++;
+		shadow.saved_indices[shadow.saved_top++] = shadow.index;
+		return;
 	}
+
+	size_t slot = (shadow.saved_top - MAX_SAVED_CONTEXTS) % CONTEXT_CHUNK_SIZE;
+
+	if(slot == 0)
+	{
+		void** chunk = shadow.spare_chunk;
+		shadow.spare_chunk = NULL;
+
+		if(!chunk)
+		{
+			chunk =
+				Dereferee::allocate_backtrace_array(CONTEXT_CHUNK_SIZE + 1);
+		}
+
+		// Nothing else is lost if the context cannot be saved, so report it
+		// and carry on; the restore that matches this save is ignored, as
+		// are any saves and restores nested inside it.
+		if(!chunk)
+		{
+			shadow.unsaved = 1;
+			warning(Dereferee::warning_context_stack_exhausted,
+				(int)shadow.saved_top + 1);
+			return;
+		}
+
+		chunk[0] = shadow.saved_chunk;
+		shadow.saved_chunk = chunk;
+	}
+
+	shadow.saved_chunk[slot + 1] = (void*)(size_t)shadow.index;
+	shadow.saved_top++;
 }
 
 // ---------------------------------------------------------------------------
 void gcc_bfd_platform::restore_current_context()
 {
-	if (saved_back_trace_top)
+	if(shadow.unsaved)
 	{
-		saved_back_trace_top--;
-		back_trace_index = saved_back_trace_indices[saved_back_trace_top];
+		shadow.unsaved--;
+		return;
+	}
+
+	if(shadow.saved_top == 0)
+		return;
+
+	shadow.saved_top--;
+
+	if(shadow.saved_top < MAX_SAVED_CONTEXTS)
+	{
+		shadow.index = shadow.saved_indices[shadow.saved_top];
+		return;
+	}
+
+	size_t slot = (shadow.saved_top - MAX_SAVED_CONTEXTS) % CONTEXT_CHUNK_SIZE;
+	shadow.index = (uint32_t)(size_t)shadow.saved_chunk[slot + 1];
+
+	if(slot == 0)
+	{
+		void** chunk = shadow.saved_chunk;
+		shadow.saved_chunk = (void**)chunk[0];
+
+		if(shadow.spare_chunk)
+			Dereferee::free_backtrace_array(chunk);
+		else
+			shadow.spare_chunk = chunk;
 	}
 }
 
+// ---------------------------------------------------------------------------
+void gcc_bfd_platform::warning(Dereferee::warning_code code, ...)
+{
+	va_list args;
+	va_start(args, code);
+
+	Dereferee::current_listener()->warning(code, args);
+
+	va_end(args);
+}
+
 
 // ===========================================================================
 
@@ -359,6 +882,83 @@ static void find_bfd_address(bfd* abfd, asection* section, void* data)
 		&info->filename, &info->funcName, (unsigned int*)(&info->line));
 }
 
+#ifndef __CYGWIN__
+// ---------------------------------------------------------------------------
+static int find_load_address(struct dl_phdr_info* info, size_t /* size */,
+	void* data)
+{
+	*(void**)data = (void*)info->dlpi_addr;
+	return 1;
+}
+#endif
+
+#ifdef DEREFEREE_UNWIND_BACKTRACES
+// ---------------------------------------------------------------------------
+static _Unwind_Reason_Code collect_frame(struct _Unwind_Context* context,
+	void* data)
+{
+	unwind_state* state = (unwind_state*)data;
+
+	if(state->skip > 0)
+	{
+		state->skip--;
+		return _URC_NO_REASON;
+	}
+
+	void* pc = (void*)_Unwind_GetIP(context);
+
+	if(pc == NULL || state->count == state->capacity)
+		return _URC_END_OF_STACK;
+
+	state->frames[state->count++] = pc;
+	return _URC_NO_REASON;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+static int compare_function_entries(const void* lhs, const void* rhs)
+{
+	bfd_vma lhs_address = ((const function_entry*)lhs)->address;
+	bfd_vma rhs_address = ((const function_entry*)rhs)->address;
+
+	if(lhs_address < rhs_address)
+		return -1;
+	else if(lhs_address > rhs_address)
+		return 1;
+	else
+		return 0;
+}
+
+// ---------------------------------------------------------------------------
+static void find_indexed_address(platform_symbol_info* info)
+{
+	// Find the last function that starts at or before the address; the
+	// address is then in that function's section, unless it lies past the
+	// end of the section, in which case every section must be searched.
+
+	unsigned long low = 0;
+	unsigned long high = num_functions;
+
+	while(low < high)
+	{
+		unsigned long mid = low + (high - low) / 2;
+
+		if(function_index[mid].address <= info->pc)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if(low > 0)
+	{
+		asection* section = function_index[low - 1].section;
+		find_bfd_address(abfd, section, info);
+	}
+
+	if(!info->found)
+		bfd_map_over_sections(abfd, &find_bfd_address, info);
+}
+
 // ---------------------------------------------------------------------------
 void destroy_symbol_table()
 {
@@ -407,6 +1007,12 @@ symbol_table::~symbol_table()
 	if(sym_table)
 		free(sym_table);
 
+	if(function_index)
+		free(function_index);
+
+	if(prepared_symbols)
+		free(prepared_symbols);
+
 	if(abfd)
 		bfd_close(abfd);
 }
@@ -451,6 +1057,143 @@ void symbol_table::load_symbol_info()
 	}
 
 	symbols_loaded = true;
+
+	build_function_index();
+}
+
+// ---------------------------------------------------------------------------
+void symbol_table::build_function_index()
+{
+	unsigned long count = 0;
+
+	for(unsigned long i = 0; i < num_symbols; i++)
+	{
+		if(syms[i]->flags & BSF_FUNCTION)
+			count++;
+	}
+
+	if(count == 0)
+		return;
+
+	function_index = (function_entry*)malloc(count * sizeof(function_entry));
+	if(!function_index)
+		return;
+
+	for(unsigned long i = 0; i < num_symbols; i++)
+	{
+		asymbol* sym = syms[i];
+
+		if(!(sym->flags & BSF_FUNCTION))
+			continue;
+
+		if(!(bfd_get_section_flags(abfd, sym->section) & SEC_ALLOC))
+			continue;
+
+		function_index[num_functions].address = bfd_asymbol_value(sym);
+		function_index[num_functions].section = sym->section;
+		num_functions++;
+	}
+
+	qsort(function_index, num_functions, sizeof(function_entry),
+		&compare_function_entries);
+}
+
+// ---------------------------------------------------------------------------
+const platform_symbol_info* symbol_table::resolve_address(bfd_vma address)
+{
+	size_t low = 0;
+	size_t high = num_prepared_symbols;
+
+	while(low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+
+		if(prepared_symbols[mid].pc < address)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if(low < num_prepared_symbols && prepared_symbols[low].pc == address)
+		return &prepared_symbols[low];
+
+	symbol_cache_entry* victim = &symbol_cache[0];
+
+	for(size_t i = 0; i < SYMBOL_CACHE_SIZE; i++)
+	{
+		symbol_cache_entry* entry = &symbol_cache[i];
+
+		if(entry->last_used && entry->info.pc == address)
+		{
+			entry->last_used = ++symbol_cache_clock;
+			return &entry->info;
+		}
+
+		if(entry->last_used < victim->last_used)
+			victim = entry;
+	}
+
+	// The stamps would only wrap around after four billion lookups, but if
+	// they do, start over with an empty cache rather than evicting the
+	// wrong entries.
+
+	if(symbol_cache_clock == (uint32_t)~0)
+	{
+		memset(symbol_cache, 0, sizeof(symbol_cache));
+		symbol_cache_clock = 0;
+		victim = &symbol_cache[0];
+	}
+
+	victim->info.pc = address;
+	look_up_address(&victim->info);
+
+	victim->last_used = ++symbol_cache_clock;
+	return &victim->info;
+}
+
+// ---------------------------------------------------------------------------
+void symbol_table::look_up_address(platform_symbol_info* info)
+{
+	info->filename = NULL;
+	info->funcName = NULL;
+	info->line = 0;
+	info->found = 0;
+
+	if(abfd)
+	{
+		if(function_index)
+			find_indexed_address(info);
+		else
+			bfd_map_over_sections(abfd, &find_bfd_address, info);
+	}
+}
+
+// ---------------------------------------------------------------------------
+void symbol_table::prepare_addresses(void** addresses, size_t count)
+{
+	if(prepared_symbols)
+		free(prepared_symbols);
+
+	prepared_symbols = NULL;
+	num_prepared_symbols = 0;
+
+	if(!symbols_loaded || count == 0)
+		return;
+
+	// If there is not enough memory, each address is simply resolved when
+	// it is asked for.
+	prepared_symbols = (platform_symbol_info*)malloc(
+		count * sizeof(platform_symbol_info));
+	if(!prepared_symbols)
+		return;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		prepared_symbols[i].pc = (bfd_vma)addresses[i];
+		look_up_address(&prepared_symbols[i]);
+	}
+
+	num_prepared_symbols = count;
 }
 
 // ---------------------------------------------------------------------------
@@ -459,15 +1202,10 @@ const char *symbol_table::symbol_name_at_address(bfd_vma address)
 	if(!symbols_loaded)
 		return NULL;
 
-	platform_symbol_info info;
-	info.pc = address;
-	info.found = 0;
-
-	if(abfd)
-		bfd_map_over_sections(abfd, &find_bfd_address, &info);
+	const platform_symbol_info* info = resolve_address(address);
 
-	if(info.found)
-		return info.funcName;
+	if(info->found)
+		return info->funcName;
 	else
 		return NULL;
 }
@@ -498,18 +1236,13 @@ bfd_vma symbol_table::source_location_at_address(bfd_vma address,
 	if(!symbols_loaded)
 		return 0;
 
-	platform_symbol_info info;
-	info.pc = address;
-	info.found = 0;
+	const platform_symbol_info* info = resolve_address(address);
 
-	if(abfd)
-		bfd_map_over_sections(abfd, &find_bfd_address, &info);
-
-	if(info.found)
+	if(info->found)
 	{
-		*path = info.filename;
-		*line = info.line;
-		return (bfd_vma)info.pc;
+		*path = info->filename;
+		*line = info->line;
+		return (bfd_vma)info->pc;
 	}
 	else
 		return 0;
@@ -559,11 +1292,11 @@ void __cyg_profile_func_enter(void *this_fn, void *call_site)
 	// we may wish to change this to drop the *earliest* frames, rather than
 	// the latest ones.
 
-    if ((int)back_trace_index != (int)MAX_BACKTRACE_SIZE)
+    if ((int)shadow.index != (int)MAX_BACKTRACE_SIZE)
 	{
-		back_trace[back_trace_index].function = this_fn;
-		back_trace[back_trace_index].call_site = call_site;
-		back_trace_index++;
+		shadow.frames[shadow.index].function = this_fn;
+		shadow.frames[shadow.index].call_site = call_site;
+		shadow.index++;
 	}
 }
 
@@ -572,6 +1305,6 @@ void __cyg_profile_func_exit(void *this_fn, void *call_site)
 {
 	using namespace DerefereeSupport;
 
-    if (back_trace_index)
-    	back_trace_index--;
+    if (shadow.index)
+    	shadow.index--;
 }
@@ -290,7 +290,10 @@ gcc_macosx_platform::~gcc_macosx_platform()
 void** gcc_macosx_platform::get_backtrace(void* /* instr_ptr */,
 		void* /* frame_ptr */)
 {
-    void** bt = (void**) calloc(128, sizeof(void*));
+    void** bt = Dereferee::allocate_backtrace_array(128);
+    if(!bt)
+        return NULL;
+
     backtrace(bt, 127);
     return bt;
 }
@@ -298,8 +301,7 @@ void** gcc_macosx_platform::get_backtrace(void* /* instr_ptr */,
 // ------------------------------------------------------------------
 void gcc_macosx_platform::free_backtrace(void** backtrace)
 {
-	if(backtrace)
-		free(backtrace);
+	Dereferee::free_backtrace_array(backtrace);
 }
 
 // ------------------------------------------------------------------
@@ -0,0 +1,35 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// ===========================================================================
+/**
+ * The gcc_unwind_platform is the gcc_bfd_platform, except that backtraces
+ * are captured by unwinding the stack with _Unwind_Backtrace when Dereferee
+ * requests one, instead of being recorded on entry to and exit from every
+ * function. Code therefore does not need to be compiled with
+ * -finstrument-functions, which makes programs that make many small function
+ * calls run much faster; the cost is moved to allocations, which now walk
+ * the stack (the "backtrace.*" options of gcc_bfd_platform reduce it).
+ *
+ * Symbols are still read with libbfd, so the same libraries must be linked.
+ * Unwinding relies on the unwind tables that GCC emits by default on most
+ * targets, and -fno-omit-frame-pointer is not needed.
+ */
+
+#define DEREFEREE_UNWIND_BACKTRACES
+#include <dereferee/gcc_bfd_platform.cpp>
@@ -205,7 +205,15 @@ enum warning_code
 	 * to invalid array indexing or pointer arithmetic
 	 * 
 	 * Extra arguments: location (memory_corruption_location) */
-	warning_memory_boundary_corrupted
+	warning_memory_boundary_corrupted,
+
+	/* Signal-protected regions (such as CxxTest's) were nested so deeply
+	 * that the platform could not obtain memory to save the backtrace
+	 * context of another one, so backtraces may be wrong until the program
+	 * leaves the regions that were not saved
+	 *
+	 * Extra arguments: nesting depth (int) */
+	warning_context_stack_exhausted
 };
 
 
@@ -347,12 +355,31 @@ public:
         return UINT_MAX;
 	}
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the number of deleted blocks of memory that the memory manager
+	 * should hold in quarantine instead of returning them to the system
+	 * immediately. Quarantined addresses cannot be reused by new allocations,
+	 * and the manager remembers where each quarantined block was allocated
+	 * so that errors involving dangling pointers to it can be described more
+	 * precisely (see describe_deleted_block).
+	 *
+	 * The default implementation returns 0, which disables the quarantine.
+	 *
+	 * @returns the maximum number of deleted blocks to hold in quarantine
+	 */
+	virtual size_t quarantine_size()
+	{
+		return 0;
+	}
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Called by the memory manager to notify the listener that the end-of-
 	 * execution memory usage report is about to begin. This call will be
-	 * followed by zero or more calls to report_leak(), then by zero or one
-	 * call to report_truncated(), and then a call to end_report().
+	 * followed by zero or more calls to report_leak() (or report_leak_site(),
+	 * if group_leaks_by_site() returns true), then by zero or one call to
+	 * report_truncated(), and then a call to end_report().
 	 *
 	 * The default implementation does nothing.
 	 *
@@ -392,6 +419,63 @@ public:
 	{
 	}
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Called by the memory manager before the end-of-execution report to
+	 * ask whether leaks should be reported one allocation site at a time
+	 * instead of one block at a time. Blocks were allocated at the same site
+	 * if their backtraces are identical. If this returns true, then
+	 * report_leak_site() is called once for each site instead of
+	 * report_leak() once for each block, and maximum_leaks_to_report()
+	 * limits the number of sites that are reported.
+	 *
+	 * The default implementation returns false.
+	 *
+	 * @returns true to group leaks by allocation site
+	 */
+	virtual bool group_leaks_by_site()
+	{
+		return false;
+	}
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Called by the memory manager to report that one or more blocks of
+	 * memory allocated at the same site were leaked at the end of program
+	 * execution. Leaks for which no backtrace is known cannot be told apart
+	 * by site, so each of them is reported with its own call to
+	 * report_leak() instead.
+	 *
+	 * The default implementation calls report_leak() with the block that is
+	 * passed in.
+	 *
+	 * @param leak an allocation_info object that can be queried for
+	 *     information about one of the blocks that were leaked
+	 * @param count the number of blocks leaked from the same site
+	 */
+	virtual void report_leak_site(const allocation_info& leak,
+								  size_t /* count */)
+	{
+		report_leak(leak);
+	}
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Called by the memory manager before the end-of-execution report to
+	 * ask whether the listener will ask the platform for the source
+	 * information of the frames in the leaks' backtraces. If it will, the
+	 * manager lets the platform resolve all of those frames together before
+	 * the leaks are reported (see platform::prepare_backtrace_frames).
+	 *
+	 * The default implementation returns true.
+	 *
+	 * @returns true if leak reports include symbolized backtraces
+	 */
+	virtual bool symbolizes_backtraces()
+	{
+		return true;
+	}
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Called by the memory manager if the number of actual leaks is greater
@@ -432,6 +516,24 @@ public:
 	 */
 	virtual void error(error_code /* code */, va_list /* args */) = 0;
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Called by the memory manager immediately before error() when the error
+	 * was caused by using a dangling pointer to (or deleting again) a block
+	 * of memory that is still held in quarantine. The listener can use this
+	 * to add the block's allocation backtrace to the error that follows.
+	 * The allocation_info is only valid for the duration of the call, but
+	 * its backtrace remains valid until error() returns.
+	 *
+	 * The default implementation does nothing.
+	 *
+	 * @param block an allocation_info object that can be queried for
+	 *     information about the deleted block of memory
+	 */
+	virtual void describe_deleted_block(const allocation_info& /* block */)
+	{
+	}
+
 	// -----------------------------------------------------------------------
 	/**
 	 * This method is called by the memory manager to notify the listener of
@@ -559,6 +661,18 @@ public:
 typedef void (* allocation_visitor)(allocation_info&, void*);
 
 
+// ---------------------------------------------------------------------------
+/**
+ * The signature of an allocation visitor function that can stop the visit
+ * early:
+ * bool my_allocation_visitor(allocation_info& alloc_info, void* arg);
+ *
+ * The function returns true to continue on to the next block, or false to
+ * stop.
+ */
+typedef bool (* allocation_visitor_while)(allocation_info&, void*);
+
+
 // ===========================================================================
 /**
  * This interface is used by the begin_report() method of a listener so that
@@ -659,9 +773,50 @@ public:
 	 * @returns the number of calls to operator delete[] with a null argument
 	 */
 	virtual size_t calls_to_array_delete_null() const = 0;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of bytes that the memory manager reserved from the
+	 * system, in slabs, for its own bookkeeping (the memory table entries and
+	 * backtraces that are kept for every allocation). This memory is not
+	 * included in any of the other statistics.
+	 *
+	 * @returns the number of bytes reserved for bookkeeping
+	 */
+	virtual size_t arena_bytes_reserved() const = 0;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of slabs that the memory manager reserved from the
+	 * system for its own bookkeeping; that is, the number of times that it
+	 * had to call malloc on its own behalf.
+	 *
+	 * @returns the number of bookkeeping slabs reserved
+	 */
+	virtual size_t arena_slabs_reserved() const = 0;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of bookkeeping objects (memory table entries and
+	 * backtraces) that the memory manager carved out of its slabs during
+	 * program execution.
+	 *
+	 * @returns the number of bookkeeping objects allocated
+	 */
+	virtual size_t arena_objects_allocated() const = 0;
 };
 
 
+// ---------------------------------------------------------------------------
+/**
+ * Gets the active listener in use by Dereferee. Platforms can use this to
+ * report the warnings that concern them.
+ *
+ * @returns the active listener
+ */
+extern listener* current_listener();
+
+
 } // namespace Dereferee
 
 
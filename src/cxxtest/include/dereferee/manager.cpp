@@ -32,7 +32,9 @@
 
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <memory>
+#include <stdint.h>
 #include <dereferee/manager.h>
 #include <dereferee/allocation_info_impl.h>
 
@@ -40,9 +42,25 @@
 
 #define __DMI ::Dereferee::manager::instance()
 
+/**
+ * The default size of the safety zones before and after each block, which
+ * can be changed with the "safety.size" platform option. Sizes are rounded
+ * up to a multiple of DEREFEREE_SAFETY_ALIGNMENT so that the blocks handed
+ * to the program stay as well aligned as those returned by malloc.
+ */
 #define DEREFEREE_SAFETY_SIZE 16
+#define DEREFEREE_SAFETY_ALIGNMENT 16
 #define DEREFEREE_SAFETY_CHAR '!'
 
+/**
+ * The number of bytes at the beginning of each block that are zeroed when
+ * it is deleted in the "prefix" poisoning mode, unless the
+ * "free.poison.prefix" platform option says otherwise. This covers the
+ * vtable pointer and the first few fields of most objects.
+ */
+#define DEREFEREE_POISON_PREFIX 64
+#define DEREFEREE_POISON_ALL ((size_t)-1)
+
 
 // ===========================================================================
 
@@ -94,6 +112,67 @@ void visit_allocations(allocation_visitor visitor, void* arg)
 	__DMI->visit_allocations(visitor, arg);
 }
 
+// ---------------------------------------------------------------------------
+bool visit_allocations_while(allocation_visitor_while visitor, void* arg)
+{
+	return __DMI->visit_allocations_while(visitor, arg);
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * The table of type names shared by the whole program.
+ */
+static type_name_table type_names;
+
+typename_t intern_type_name(const char* name)
+{
+	return type_names.intern(name);
+}
+
+// ---------------------------------------------------------------------------
+const char* interned_type_name(typename_t id)
+{
+	return type_names.name(id);
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * The table of backtraces shared by the whole program.
+ */
+static backtrace_table backtraces;
+
+backtrace_t intern_backtrace(void** frames)
+{
+	return backtraces.intern(frames);
+}
+
+// ---------------------------------------------------------------------------
+void** interned_backtrace(backtrace_t id)
+{
+	return backtraces.frames(id);
+}
+
+// ---------------------------------------------------------------------------
+backtrace_t interned_backtrace_count()
+{
+	return backtraces.count();
+}
+
+// ---------------------------------------------------------------------------
+void** allocate_backtrace_array(size_t entries)
+{
+	return __DMI->_backtrace_pool.allocate(entries);
+}
+
+// ---------------------------------------------------------------------------
+void free_backtrace_array(void** backtrace)
+{
+	// If the manager has already been destroyed, so has the pool that this
+	// backtrace came from.
+	if(manager::existing_instance())
+		__DMI->_backtrace_pool.release(backtrace);
+}
+
 
 // ===========================================================================
 /**
@@ -101,6 +180,207 @@ void visit_allocations(allocation_visitor visitor, void* arg)
  */
 manager* manager::_instance = 0;
 
+mutex manager::_instance_lock;
+
+/**
+ * The block of tags that the current thread has reserved from the manager
+ * and has not yet handed out.
+ */
+struct tag_block
+{
+	const manager* owner;
+	memtag_t next;
+	memtag_t limit;
+};
+
+static DEREFEREE_THREAD_LOCAL tag_block thread_tags = { 0, 0, 0 };
+
+// ---------------------------------------------------------------------------
+/**
+ * Adapts an allocation_visitor to the walk of the memory table.
+ */
+struct visitor_call
+{
+	allocation_visitor visitor;
+	allocation_visitor_while visitor_while;
+	void* arg;
+};
+
+static bool call_visitor(mem_info& info, void* arg)
+{
+	visitor_call* call = (visitor_call*)arg;
+	allocation_info_impl alloc_info(info);
+
+	if(call->visitor_while)
+		return call->visitor_while(alloc_info, call->arg);
+
+	call->visitor(alloc_info, call->arg);
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns true if every byte in the specified range is DEREFEREE_SAFETY_CHAR.
+ * The range is compared a word at a time against a word filled with the
+ * pattern, with single bytes only at the unaligned ends.
+ */
+static bool safety_zone_intact(const char* start, size_t length)
+{
+	const unsigned char* p = (const unsigned char*)start;
+	const unsigned char* end = p + length;
+
+	while(p < end && ((uintptr_t)p % sizeof(uintptr_t)) != 0)
+	{
+		if(*p++ != (unsigned char)DEREFEREE_SAFETY_CHAR)
+			return false;
+	}
+
+	const uintptr_t pattern = ((uintptr_t)~(uintptr_t)0 / 0xFF)
+		* (unsigned char)DEREFEREE_SAFETY_CHAR;
+
+	for(; p + sizeof(uintptr_t) <= end; p += sizeof(uintptr_t))
+	{
+		if(*(const uintptr_t*)p != pattern)
+			return false;
+	}
+
+	while(p < end)
+	{
+		if(*p++ != (unsigned char)DEREFEREE_SAFETY_CHAR)
+			return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * Checks the safety zones of the specified size before and after a block.
+ *
+ * @returns a combination of the memory_corruption_location values that
+ *     indicates which of the zones were damaged
+ */
+static int check_safety_zones(const void* address, size_t size,
+							  size_t safety_size)
+{
+	int damage = memory_corruption_none;
+
+	if(!safety_zone_intact((const char*)address - safety_size, safety_size))
+		damage |= memory_corruption_before;
+
+	if(!safety_zone_intact((const char*)address + size, safety_size))
+		damage |= memory_corruption_after;
+
+	return damage;
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * The state of the scan for damaged safety zones.
+ */
+struct safety_scan
+{
+	size_t safety_size;
+	mem_info* damaged;
+	int damage;
+};
+
+// ---------------------------------------------------------------------------
+/**
+ * The state of the sweep over the memory table that counts leaks and picks
+ * out the ones to report. Checked leaks are stored from the front of the
+ * reports array and unchecked ones from the back, so that checked leaks can
+ * be reported first without a second sweep; a checked leak takes the place
+ * of the most recently stored unchecked one when the array is full.
+ */
+struct leak_sweep
+{
+	listener* leak_listener;
+	size_t total;
+	mem_info** reports;
+	size_t capacity;
+	size_t checked;
+	size_t unchecked;
+};
+
+// ---------------------------------------------------------------------------
+/**
+ * The state of the sweep over the memory table that groups leaks by the
+ * site where they were allocated. Both arrays are indexed by the identifier
+ * of a backtrace; the first leak of each site is kept as the one to report,
+ * except that a checked leak takes the place of an unchecked one. Leaks
+ * without a backtrace are kept one by one in the singles array instead, up
+ * to its capacity.
+ */
+struct site_sweep
+{
+	listener* leak_listener;
+	size_t total;
+	size_t* counts;
+	mem_info** firsts;
+	mem_info** singles;
+	size_t single_capacity;
+	size_t single_count;
+};
+
+static bool sweep_leak(mem_info& info, void* arg)
+{
+	leak_sweep* sweep = (leak_sweep*)arg;
+	allocation_info_impl alloc_info(info);
+
+	if(!sweep->leak_listener->should_report_leak(alloc_info))
+		return true;
+
+	sweep->total++;
+
+	if(info.is_checked)
+	{
+		if(sweep->checked < sweep->capacity)
+		{
+			if(sweep->checked + sweep->unchecked == sweep->capacity)
+				sweep->unchecked--;
+
+			sweep->reports[sweep->checked++] = &info;
+		}
+	}
+	else if(sweep->checked + sweep->unchecked < sweep->capacity)
+	{
+		sweep->unchecked++;
+		sweep->reports[sweep->capacity - sweep->unchecked] = &info;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+static bool sweep_leak_site(mem_info& info, void* arg)
+{
+	site_sweep* sweep = (site_sweep*)arg;
+	allocation_info_impl alloc_info(info);
+
+	if(!sweep->leak_listener->should_report_leak(alloc_info))
+		return true;
+
+	sweep->total++;
+
+	if(info.backtrace == 0)
+	{
+		if(sweep->single_count < sweep->single_capacity)
+			sweep->singles[sweep->single_count++] = &info;
+
+		return true;
+	}
+
+	sweep->counts[info.backtrace]++;
+
+	mem_info* first = sweep->firsts[info.backtrace];
+
+	if(!first || (info.is_checked && !first->is_checked))
+		sweep->firsts[info.backtrace] = &info;
+
+	return true;
+}
+
 // ---------------------------------------------------------------------------
 /**
  * This function destroys the Dereferee memory manager when program execution
@@ -127,16 +407,14 @@ void destroy_manager()
 manager::manager()
 {
 	_uninit_handle = malloc(4);
-
-	_next_tag = 0;
-	_checked_table_size = 0;
-	_unchecked_table_size = 0;
-
-	_checked_table = NULL;
-	_unchecked_table = NULL;
+	_safety_size = DEREFEREE_SAFETY_SIZE;
+	_safety_scan_interval = 0;
+	_poison_prefix = DEREFEREE_POISON_ALL;
 
 	initialize_platform();
 	initialize_listener();
+
+	_quarantine.set_capacity(_listener->quarantine_size());
 }
 
 // ------------------------------------------------------------------
@@ -152,6 +430,7 @@ void manager::initialize_platform()
 	int ct_option_len = strlen(_DEREFEREE_PLATFORM_OPTIONS);
 	char* ct_option_buf = (char*)malloc(ct_option_len + 1);
 	strncpy(ct_option_buf, _DEREFEREE_PLATFORM_OPTIONS, ct_option_len);
+	ct_option_buf[ct_option_len] = '\0';
 
 	size_t num_options = 0;
 	size_t cap_options = 4;
@@ -182,6 +461,7 @@ void manager::initialize_platform()
 		int rt_option_len = strlen(envvar);
 		rt_option_buf = (char*)malloc(rt_option_len + 1);
 		strncpy(rt_option_buf, envvar, rt_option_len);
+		rt_option_buf[rt_option_len] = '\0';
 
 		for(pair_start = DEREFEREE_STRTOK(rt_option_buf, sep_semi, &next_pair);
 			pair_start != NULL;
@@ -208,6 +488,7 @@ void manager::initialize_platform()
 	options[num_options].key = NULL;
 	options[num_options].value = NULL;
 
+	apply_platform_options(options);
 	_platform = create_platform(options);
 
 	if(rt_option_buf)
@@ -231,6 +512,7 @@ void manager::initialize_listener()
 	int ct_option_len = strlen(_DEREFEREE_LISTENER_OPTIONS);
 	char* ct_option_buf = (char*)malloc(ct_option_len + 1);
 	strncpy(ct_option_buf, _DEREFEREE_LISTENER_OPTIONS, ct_option_len);
+	ct_option_buf[ct_option_len] = '\0';
 
 	size_t num_options = 0;
 	size_t cap_options = 4;
@@ -261,6 +543,7 @@ void manager::initialize_listener()
 		int rt_option_len = strlen(envvar);
 		rt_option_buf = (char*)malloc(rt_option_len + 1);
 		strncpy(rt_option_buf, envvar, rt_option_len);
+		rt_option_buf[rt_option_len] = '\0';
 
 		for(pair_start = DEREFEREE_STRTOK(rt_option_buf, sep_semi, &next_pair);
 			pair_start != NULL;
@@ -297,6 +580,49 @@ void manager::initialize_listener()
 	free(ct_option_buf);
 }
 
+// ------------------------------------------------------------------
+void manager::apply_platform_options(const option* options)
+{
+	bool poison_prefix_only = false;
+	size_t poison_prefix = DEREFEREE_POISON_PREFIX;
+
+	for(; options->key != NULL; options++)
+	{
+		if(strcmp(options->key, "memtab.index") == 0)
+		{
+			if(strcmp(options->value, "pages") == 0)
+				memtab_set_index_mode(memtab_index_pages);
+			else if(strcmp(options->value, "tree") == 0)
+				memtab_set_index_mode(memtab_index_tree);
+		}
+		else if(strcmp(options->key, "safety.size") == 0)
+		{
+			size_t size = strtoul(options->value, NULL, 10);
+
+			_safety_size = (size + DEREFEREE_SAFETY_ALIGNMENT - 1)
+				& ~(size_t)(DEREFEREE_SAFETY_ALIGNMENT - 1);
+		}
+		else if(strcmp(options->key, "safety.scan.interval") == 0)
+		{
+			_safety_scan_interval = strtoul(options->value, NULL, 10);
+		}
+		else if(strcmp(options->key, "free.poison") == 0)
+		{
+			if(strcmp(options->value, "full") == 0)
+				poison_prefix_only = false;
+			else if(strcmp(options->value, "prefix") == 0)
+				poison_prefix_only = true;
+		}
+		else if(strcmp(options->key, "free.poison.prefix") == 0)
+		{
+			poison_prefix = strtoul(options->value, NULL, 10);
+		}
+	}
+
+	_poison_prefix =
+		poison_prefix_only ? poison_prefix : DEREFEREE_POISON_ALL;
+}
+
 // ------------------------------------------------------------------
 void manager::add_option(option*& options,
 		size_t& num_options, size_t& cap_options, const char* key,
@@ -329,26 +655,43 @@ void manager::add_option(option*& options,
 // ------------------------------------------------------------------
 manager* manager::instance()
 {
-	if(_instance == 0)
+	manager* existing = atomic_load_pointer(_instance);
+
+	if(existing == 0)
 	{
-		_instance = new manager();
-		atexit(destroy_manager);
+		scoped_lock lock(_instance_lock);
+
+		existing = _instance;
+
+		if(existing == 0)
+		{
+			existing = new manager();
+			atomic_store_pointer(_instance, existing);
+			atexit(destroy_manager);
+		}
 	}
 
-	return _instance;
+	return existing;
 }
 
 // ------------------------------------------------------------------
 manager* manager::existing_instance()
 {
-	return _instance;
+	return atomic_load_pointer(_instance);
 }
 
 // ------------------------------------------------------------------
 manager::~manager()
 {
-	memtab_destroy_table(_checked_table);
-	memtab_destroy_table(_unchecked_table);
+	void* block;
+	mem_info info;
+
+	while(_quarantine.remove_oldest(block, info))
+		release_block(block, info);
+
+	for(size_t i = 0; i <= DEREFEREE_MEMTAB_SHARDS; i++)
+		memtab_destroy_table(_entry_pool, _shards[i].root,
+			_shards[i].pages);
 
 	destroy_listener(_listener);
 	destroy_platform(_platform);
@@ -361,65 +704,277 @@ manager::~manager()
 // ------------------------------------------------------------------
 memtag_t manager::next_tag()
 {
-	return _next_tag++;
+	tag_block& tags = thread_tags;
+
+	if(tags.owner != this || tags.next == tags.limit)
+	{
+		tags.next = (memtag_t)(_next_tag.add(DEREFEREE_TAG_BLOCK_SIZE)
+			- DEREFEREE_TAG_BLOCK_SIZE);
+		tags.limit = tags.next + DEREFEREE_TAG_BLOCK_SIZE;
+		tags.owner = this;
+	}
+
+	return tags.next++;
 }
 
 // ------------------------------------------------------------------
-unsigned long manager::move_to_checked(const void* address)
+memtab_shard& manager::home_shard(const void* address, size_t size)
 {
-	memtab_entry* curr_node = memtab_find_address(_unchecked_table, address);
-	if(curr_node)
+	if(size >= ((size_t)1 << DEREFEREE_MEMTAB_REGION_SHIFT))
+		return _shards[DEREFEREE_MEMTAB_SHARDS];
+
+	uintptr_t region = (uintptr_t)address >> DEREFEREE_MEMTAB_REGION_SHIFT;
+	return _shards[region % DEREFEREE_MEMTAB_SHARDS];
+}
+
+// ------------------------------------------------------------------
+memtab_shard* manager::lock_entry(const void* address, memtab_entry*& entry)
+{
+	// A small block that contains the address starts either in the same
+	// region as the address or in the one before it.
+	uintptr_t region = (uintptr_t)address >> DEREFEREE_MEMTAB_REGION_SHIFT;
+
+	memtab_shard* candidates[3] = {
+		&_shards[region % DEREFEREE_MEMTAB_SHARDS],
+		&_shards[(region - 1) % DEREFEREE_MEMTAB_SHARDS],
+		&_shards[DEREFEREE_MEMTAB_SHARDS]
+	};
+
+	for(size_t i = 0; i < 3; i++)
 	{
-		memtab_entry* rem_node = memtab_remove_address(_unchecked_table,
-													   address);
-		memtab_insert_entry(_checked_table, rem_node);
+		memtab_shard* shard = candidates[i];
+		shard->lock.lock();
 
-		_unchecked_table_size--;
-		_checked_table_size++;
+		entry = memtab_find_address(shard->root, shard->pages, address);
+		if(entry)
+			return shard;
 
-		return rem_node->info.tag;
+		shard->lock.unlock();
 	}
 
-	return default_memtag;
+	entry = NULL;
+	return NULL;
 }
 
 // ------------------------------------------------------------------
-void manager::remove_checked(const void* address)
+mem_info* manager::find_info(const void* address)
 {
-	memtab_entry* curr_node = memtab_find_address(_checked_table, address);
-	if(curr_node)
+	memtab_entry* curr_node;
+	memtab_shard* shard = lock_entry(address, curr_node);
+
+	if(!shard)
+		return NULL;
+
+	mem_info* info = curr_node->info;
+	shard->lock.unlock();
+
+	return info;
+}
+
+// ------------------------------------------------------------------
+bool manager::remove_entry(const void* address, bool checked)
+{
+	memtab_entry* curr_node;
+	memtab_shard* shard = lock_entry(address, curr_node);
+
+	if(!shard)
+		return false;
+
+	bool removed = false;
+
+	if(curr_node->info->is_checked == checked)
 	{
 		memtab_entry* rem_node =
-			memtab_remove_address(_checked_table, address);
-		memtab_free(rem_node);
+			memtab_remove_entry(_entry_pool, shard->root, shard->pages,
+				curr_node);
+		memtab_free(_entry_pool, rem_node);
+		removed = true;
+	}
+
+	shard->lock.unlock();
+
+	return removed;
+}
 
-		_checked_table_size--;
+// ------------------------------------------------------------------
+manager::take_result manager::take_entry(const void* address, bool is_array,
+	bool force, mem_info& info)
+{
+	memtab_entry* curr_node;
+	memtab_shard* shard = lock_entry(address, curr_node);
+
+	if(!shard)
+		return take_not_found;
+
+	info = *curr_node->info;
+
+	if(!force && info.is_array != is_array)
+	{
+		shard->lock.unlock();
+		return take_wrong_form;
 	}
+
+	memtab_entry* rem_node =
+		memtab_remove_entry(_entry_pool, shard->root, shard->pages,
+			curr_node);
+	memtab_free(_entry_pool, rem_node);
+
+	shard->lock.unlock();
+
+	if(info.is_checked)
+		_checked_count.subtract(1);
+	else
+		_unchecked_count.subtract(1);
+
+	return take_removed;
 }
 
 // ------------------------------------------------------------------
-void manager::remove_unchecked(const void* address)
+void manager::lock_all_shards()
+{
+	for(size_t i = 0; i <= DEREFEREE_MEMTAB_SHARDS; i++)
+		_shards[i].lock.lock();
+}
+
+// ------------------------------------------------------------------
+void manager::unlock_all_shards()
 {
-	memtab_entry* curr_node = memtab_find_address(_unchecked_table, address);
-	if(curr_node)
+	for(size_t i = DEREFEREE_MEMTAB_SHARDS + 1; i > 0; i--)
+		_shards[i - 1].lock.unlock();
+}
+
+// ------------------------------------------------------------------
+bool manager::walk_allocations(entry_visitor visitor, void* arg)
+{
+	// Each shard's table is already in order of address, so the shards are
+	// merged by repeatedly taking the lowest of their current entries.
+	memtab_cursor cursors[DEREFEREE_MEMTAB_SHARDS + 1];
+
+	for(size_t i = 0; i <= DEREFEREE_MEMTAB_SHARDS; i++)
+		memtab_cursor_begin(cursors[i], _shards[i].root);
+
+	for(;;)
 	{
-		memtab_entry* rem_node = memtab_remove_address(_unchecked_table,
-													   address);
-		memtab_free(rem_node);
+		memtab_cursor* lowest = NULL;
+		const void* lowest_address = NULL;
+
+		for(size_t i = 0; i <= DEREFEREE_MEMTAB_SHARDS; i++)
+		{
+			memtab_entry* entry = memtab_cursor_current(cursors[i]);
 
-		_unchecked_table_size--;
+			if(entry && (!lowest || entry->info->address < lowest_address))
+			{
+				lowest = &cursors[i];
+				lowest_address = entry->info->address;
+			}
+		}
+
+		if(!lowest)
+			return true;
+
+		mem_info* info = memtab_cursor_current(*lowest)->info;
+		memtab_cursor_advance(*lowest);
+
+		if(!visitor(*info, arg))
+			return false;
 	}
 }
 
+// ------------------------------------------------------------------
+unsigned long manager::move_to_checked(const void* address)
+{
+	memtab_entry* curr_node;
+	memtab_shard* shard = lock_entry(address, curr_node);
+
+	if(!shard)
+		return default_memtag;
+
+	// Another thread may have checked the block since the caller looked at
+	// it, so the tag is returned either way; only the thread that flips the
+	// flag moves the block between the counts.
+	memtag_t tag = curr_node->info->tag;
+	bool moved = !curr_node->info->is_checked;
+
+	if(moved)
+		curr_node->info->is_checked = true;
+
+	shard->lock.unlock();
+
+	// The counts are updated in this order so that their sum never falls
+	// below the number of blocks in the table; report_usage relies on it.
+	if(moved)
+	{
+		_checked_count.add(1);
+		_unchecked_count.subtract(1);
+	}
+
+	return tag;
+}
+
+// ------------------------------------------------------------------
+void manager::remove_checked(const void* address)
+{
+	if(remove_entry(address, true))
+		_checked_count.subtract(1);
+}
+
+// ------------------------------------------------------------------
+void manager::remove_unchecked(const void* address)
+{
+	if(remove_entry(address, false))
+		_unchecked_count.subtract(1);
+}
+
 // ------------------------------------------------------------------
 bool manager::is_checked(const void* address, memtag_t tag)
 {
-	memtab_entry* curr_node = memtab_find_address(_checked_table, address);
+	mem_info* info = find_info(address);
 
-	if(!curr_node)
+	if(!info || !info->is_checked)
 		return false;
 	else
-		return curr_node->info.tag == tag;
+		return info->tag == tag;
+}
+
+// ------------------------------------------------------------------
+mem_info* manager::checked_info(const void* address, memtag_t tag,
+	mem_info*& hint)
+{
+	// Null and uninitialized pointers carry the default tag, which is never
+	// given to an allocated block, so there is no need to search for them.
+	if(tag == default_memtag)
+	{
+		hint = NULL;
+		return NULL;
+	}
+
+	// The hint is read without a lock. If its block has been freed, and
+	// even if its mem_info has since been reused by another thread, the tag
+	// will not match, since tags are never reused. The tag is loaded again
+	// after the other fields, in case the block was freed while they were
+	// being read.
+	if(hint && atomic_load_memtag(hint->tag) == tag)
+	{
+		bool contains = hint->is_checked
+			&& hint->address <= address
+			&& address <= (const char*)hint->address + hint->block_size;
+
+		if(contains && atomic_reload_memtag(hint->tag) == tag)
+			return hint;
+	}
+
+	mem_info* info = find_info(address);
+
+	if(info && info->is_checked && info->tag == tag)
+	{
+		hint = info;
+	}
+	else
+	{
+		hint = NULL;
+	}
+
+	return hint;
 }
 
 // ------------------------------------------------------------------
@@ -431,45 +986,31 @@ void* manager::uninit_handle()
 // ------------------------------------------------------------------
 void manager::retain(const void* address)
 {
-	memtab_entry* curr_node = memtab_find_address(_checked_table, address);
-	curr_node->info.ref_count++;
+	atomic_increment(find_info(address)->ref_count);
 }
 
 // ------------------------------------------------------------------
 void manager::release(const void* address)
 {
-	memtab_entry* curr_node = memtab_find_address(_checked_table, address);
-	curr_node->info.ref_count--;
+	atomic_decrement(find_info(address)->ref_count);
 }
 
 // ------------------------------------------------------------------
 refcount_t manager::ref_count(const void* address)
 {
-	memtab_entry* curr_node = memtab_find_address(_checked_table, address);
-	return curr_node->info.ref_count;
+	return find_info(address)->ref_count;
 }
 
 // ------------------------------------------------------------------
 mem_info* manager::address_info(const void* address, bool* is_checked)
 {
-	memtab_entry* curr_node;
-
-	curr_node = memtab_find_address(_unchecked_table, address);
-	if(curr_node)
+	mem_info* info = find_info(address);
+	if(info)
 	{
 		if(is_checked)
-			*is_checked = false;
+			*is_checked = info->is_checked;
 
-		return &curr_node->info;
-	}
-
-	curr_node = memtab_find_address(_checked_table, address);
-	if(curr_node)
-	{
-		if(is_checked)
-			*is_checked = true;
-
-		return &curr_node->info;
+		return info;
 	}
 
 	return NULL;
@@ -498,95 +1039,397 @@ void manager::error(error_code code, ...)
 }
 
 // ------------------------------------------------------------------
-void manager::visit_allocations(allocation_visitor visitor, void* arg)
+void manager::deleted_pointer_error(error_code code, memtag_t tag)
 {
-    visit_allocation_entry(_checked_table, visitor, arg);
-    visit_allocation_entry(_unchecked_table, visitor, arg);
+	mem_info tombstone;
+	bool quarantined = false;
+
+	if(_quarantine.capacity() > 0)
+	{
+		scoped_lock lock(_quarantine_lock);
+
+		const mem_info* info = _quarantine.find(tag);
+		if(info)
+		{
+			tombstone = *info;
+			quarantined = true;
+		}
+	}
+
+	if(quarantined)
+		describe_deleted_block(tombstone);
+
+	error(code);
 }
 
 // ------------------------------------------------------------------
-void manager::visit_allocation_entry(memtab_entry* entry,
-                                     allocation_visitor visitor,
-                                     void* arg)
+void manager::describe_deleted_block(const mem_info& tombstone)
 {
-	if(entry)
+	mem_info info = tombstone;
+	allocation_info_impl aii(info);
+	_listener->describe_deleted_block(aii);
+}
+
+// ------------------------------------------------------------------
+static bool scan_block(mem_info& info, void* arg)
+{
+	safety_scan* scan = (safety_scan*)arg;
+
+	scan->damage = check_safety_zones(info.address, info.block_size,
+		scan->safety_size);
+
+	if(scan->damage == memory_corruption_none)
+		return true;
+
+	scan->damaged = &info;
+	return false;
+}
+
+// ------------------------------------------------------------------
+void manager::scan_safety_zones()
+{
+	safety_scan scan = { _safety_size, NULL, memory_corruption_none };
+
+	lock_all_shards();
+	walk_allocations(scan_block, &scan);
+
+	if(scan.damaged)
+	{
+		char* start = (char*)scan.damaged->address;
+
+		memset(start - _safety_size, DEREFEREE_SAFETY_CHAR, _safety_size);
+		memset(start + scan.damaged->block_size, DEREFEREE_SAFETY_CHAR,
+			_safety_size);
+	}
+
+	unlock_all_shards();
+
+	// The listener is only called once the table is unlocked, since it may
+	// not return.
+	if(scan.damaged)
 	{
-		visit_allocation_entry(entry->_1, visitor, arg);
-        allocation_info_impl aii(entry->info);
-        visitor(aii, arg);
-		visit_allocation_entry(entry->_2, visitor, arg);
+		warning(warning_memory_boundary_corrupted,
+			(memory_corruption_location)scan.damage);
 	}
 }
 
 // ------------------------------------------------------------------
-void manager::count_leaked_entries(memtab_entry* entry, size_t& total_leaks)
+void manager::release_block(void* block, mem_info& /* info */)
+{
+	free(block);
+}
+
+// ------------------------------------------------------------------
+void manager::visit_allocations(allocation_visitor visitor, void* arg)
+{
+	visitor_call call = { visitor, NULL, arg };
+
+	lock_all_shards();
+	walk_allocations(call_visitor, &call);
+	unlock_all_shards();
+}
+
+// ------------------------------------------------------------------
+bool manager::visit_allocations_while(allocation_visitor_while visitor,
+	void* arg)
+{
+	visitor_call call = { NULL, visitor, arg };
+
+	lock_all_shards();
+	bool completed = walk_allocations(call_visitor, &call);
+	unlock_all_shards();
+
+	return completed;
+}
+
+// ------------------------------------------------------------------
+void manager::report_usage()
 {
-	if(entry)
+	if(!_listener->group_leaks_by_site() || !report_usage_by_site())
+		report_usage_by_leak();
+}
+
+// ------------------------------------------------------------------
+void manager::report_usage_by_leak()
+{
+	size_t max_log = _listener->maximum_leaks_to_report();
+
+	leak_sweep sweep = { _listener, 0, NULL, 0, 0, 0 };
+
+	// One sweep over the table counts the leaks and picks out the ones that
+	// will be reported. The reports themselves are made after the table is
+	// unlocked, since the listener may allocate memory while making them.
+	lock_all_shards();
+
+	sweep.capacity = _checked_count.value() + _unchecked_count.value();
+	if(sweep.capacity > max_log)
+		sweep.capacity = max_log;
+
+	if(sweep.capacity > 0)
 	{
-		count_leaked_entries(entry->_1, total_leaks);
+		sweep.reports = (mem_info**)malloc(sweep.capacity * sizeof(mem_info*));
+		if(!sweep.reports)
+			sweep.capacity = 0;
+	}
 
-        allocation_info_impl alloc_info(entry->info);
-		if(_listener->should_report_leak(alloc_info))
+	walk_allocations(sweep_leak, &sweep);
+
+	unlock_all_shards();
+
+	finish_usage_stats(sweep.total);
+
+	// Checked blocks are reported before unchecked ones, and the unchecked
+	// ones in the order they were found, so the unchecked ones stored at the
+	// back of the array are reversed and moved up behind the checked ones.
+	size_t reports_logged = sweep.checked + sweep.unchecked;
+
+	if(sweep.unchecked > 0)
+	{
+		mem_info** unchecked =
+			sweep.reports + sweep.capacity - sweep.unchecked;
+
+		for(size_t i = 0; i < sweep.unchecked / 2; i++)
 		{
-			total_leaks++;
+			mem_info* swap = unchecked[i];
+			unchecked[i] = unchecked[sweep.unchecked - 1 - i];
+			unchecked[sweep.unchecked - 1 - i] = swap;
 		}
 
-		count_leaked_entries(entry->_2, total_leaks);
+		memmove(sweep.reports + sweep.checked, unchecked,
+			sweep.unchecked * sizeof(mem_info*));
 	}
+
+	prepare_backtraces(sweep.reports, reports_logged);
+
+	_listener->begin_report(_usage_stats);
+
+	for(size_t i = 0; i < reports_logged; i++)
+	{
+		allocation_info_impl alloc_info(*sweep.reports[i]);
+		_listener->report_leak(alloc_info);
+	}
+
+	free(sweep.reports);
+
+	if(sweep.total > reports_logged)
+	{
+		_listener->report_truncated(reports_logged, sweep.total);
+	}
+
+	_listener->end_report();
 }
 
 // ------------------------------------------------------------------
-void manager::report_leaked_entry(memtab_entry* entry, size_t max_log,
-								  size_t& reports_logged)
+bool manager::report_usage_by_site()
 {
-	if(entry)
+	size_t max_log = _listener->maximum_leaks_to_report();
+
+	site_sweep sweep = { _listener, 0, NULL, NULL, NULL, 0, 0 };
+
+	lock_all_shards();
+
+	// Every block in the table has a backtrace that was interned before the
+	// block was inserted, so once the table is locked, no block can have an
+	// identifier larger than the current count.
+	size_t sites = (size_t)interned_backtrace_count() + 1;
+
+	sweep.counts = (size_t*)calloc(sites, sizeof(size_t));
+	sweep.firsts = (mem_info**)calloc(sites, sizeof(mem_info*));
+
+	sweep.single_capacity = _checked_count.value() + _unchecked_count.value();
+	if(sweep.single_capacity > max_log)
+		sweep.single_capacity = max_log;
+
+	sweep.singles =
+		(mem_info**)malloc((sweep.single_capacity + 1) * sizeof(mem_info*));
+
+	// The sites to report are gathered in the order they will be reported,
+	// so that their backtraces can be prepared before any are reported.
+	size_t capacity = sites + sweep.single_capacity;
+	if(capacity > max_log)
+		capacity = max_log;
+
+	mem_info** reports =
+		(mem_info**)malloc((capacity + 1) * sizeof(mem_info*));
+	size_t* report_counts = (size_t*)malloc((capacity + 1) * sizeof(size_t));
+
+	if(!sweep.counts || !sweep.firsts || !sweep.singles || !reports ||
+		!report_counts)
 	{
-		report_leaked_entry(entry->_1, max_log, reports_logged);
+		unlock_all_shards();
 
-        allocation_info_impl alloc_info(entry->info);
+		free(sweep.counts);
+		free(sweep.firsts);
+		free(sweep.singles);
+		free(reports);
+		free(report_counts);
+		return false;
+	}
+
+	walk_allocations(sweep_leak_site, &sweep);
+
+	unlock_all_shards();
+
+	finish_usage_stats(sweep.total);
 
-		if(reports_logged < max_log
-		    && _listener->should_report_leak(alloc_info))
+	// Sites whose reported block is checked are reported before the others,
+	// and otherwise in the order that their backtraces were first seen. The
+	// leaks without a backtrace take the place of site 0 at the front of
+	// each group, in the order that they were found.
+	size_t sites_logged = 0;
+	size_t leaks_logged = 0;
+
+	for(int pass = 0; pass < 2; pass++)
+	{
+		bool checked_pass = (pass == 0);
+
+		for(size_t i = 0;
+			i < sweep.single_count && sites_logged < max_log; i++)
 		{
-			_listener->report_leak(alloc_info);
-			reports_logged++;
+			if(sweep.singles[i]->is_checked != checked_pass)
+				continue;
+
+			reports[sites_logged] = sweep.singles[i];
+			report_counts[sites_logged] = 1;
+
+			sites_logged++;
+			leaks_logged++;
+		}
+
+		for(size_t i = 1; i < sites && sites_logged < max_log; i++)
+		{
+			mem_info* first = sweep.firsts[i];
+
+			if(!first || first->is_checked != checked_pass)
+				continue;
+
+			reports[sites_logged] = first;
+			report_counts[sites_logged] = sweep.counts[i];
+
+			sites_logged++;
+			leaks_logged += sweep.counts[i];
 		}
+	}
+
+	free(sweep.counts);
+	free(sweep.firsts);
+	free(sweep.singles);
+
+	prepare_backtraces(reports, sites_logged);
+
+	_listener->begin_report(_usage_stats);
+
+	for(size_t i = 0; i < sites_logged; i++)
+	{
+		allocation_info_impl alloc_info(*reports[i]);
 
-		report_leaked_entry(entry->_2, max_log, reports_logged);
+		if(reports[i]->backtrace == 0)
+			_listener->report_leak(alloc_info);
+		else
+			_listener->report_leak_site(alloc_info, report_counts[i]);
 	}
+
+	free(reports);
+	free(report_counts);
+
+	if(sweep.total > leaks_logged)
+	{
+		_listener->report_truncated(leaks_logged, sweep.total);
+	}
+
+	_listener->end_report();
+
+	return true;
 }
 
 // ------------------------------------------------------------------
-void manager::report_usage()
+static int compare_frames(const void* lhs, const void* rhs)
 {
-	size_t total_leaks = 0;
+	uintptr_t lhs_frame = (uintptr_t)*(void* const*)lhs;
+	uintptr_t rhs_frame = (uintptr_t)*(void* const*)rhs;
 
-	count_leaked_entries(_checked_table, total_leaks);
-	count_leaked_entries(_unchecked_table, total_leaks);
+	if(lhs_frame < rhs_frame)
+		return -1;
+	else if(lhs_frame > rhs_frame)
+		return 1;
+	else
+		return 0;
+}
 
-	_usage_stats.set_leaks(total_leaks);
+// ------------------------------------------------------------------
+void manager::prepare_backtraces(mem_info** reports, size_t count)
+{
+	if(!_listener->symbolizes_backtraces())
+		return;
 
-	_listener->begin_report(_usage_stats);
+	size_t frame_count = 0;
 
-	size_t reports_logged = 0;
-	size_t max_log = _listener->maximum_leaks_to_report();
+	for(size_t i = 0; i < count; i++)
+	{
+		void** backtrace = interned_backtrace(reports[i]->backtrace);
+
+		for(; backtrace && *backtrace; backtrace++)
+			frame_count++;
+	}
 
-	report_leaked_entry(_checked_table, max_log, reports_logged);
-	report_leaked_entry(_unchecked_table, max_log, reports_logged);
+	if(frame_count == 0)
+		return;
 
-	if(total_leaks > reports_logged)
+	// If there is not enough memory, the platform simply resolves each frame
+	// when the listener asks for it.
+	void** frames = (void**)malloc(frame_count * sizeof(void*));
+	if(!frames)
+		return;
+
+	size_t index = 0;
+
+	for(size_t i = 0; i < count; i++)
 	{
-		_listener->report_truncated(reports_logged, total_leaks);
+		void** backtrace = interned_backtrace(reports[i]->backtrace);
+
+		for(; backtrace && *backtrace; backtrace++)
+			frames[index++] = *backtrace;
 	}
 
-	_listener->end_report();
+	qsort(frames, frame_count, sizeof(void*), &compare_frames);
+
+	size_t distinct = 1;
+
+	for(size_t i = 1; i < frame_count; i++)
+	{
+		if(frames[i] != frames[distinct - 1])
+			frames[distinct++] = frames[i];
+	}
+
+	_platform->prepare_backtrace_frames(frames, distinct);
+
+	free(frames);
+}
+
+// ------------------------------------------------------------------
+void manager::finish_usage_stats(size_t leaks)
+{
+	_usage_stats.merge_thread_counters();
+	_usage_stats.set_leaks(leaks);
+	_usage_stats.set_arena_usage(
+		_entry_pool.entries.bytes_reserved()
+			+ _entry_pool.infos.bytes_reserved()
+			+ _entry_pool.links.bytes_reserved()
+			+ _backtrace_pool.bytes_reserved(),
+		_entry_pool.entries.slab_count() + _entry_pool.infos.slab_count()
+			+ _entry_pool.links.slab_count()
+			+ _backtrace_pool.slab_count(),
+		_entry_pool.entries.objects_served()
+			+ _entry_pool.infos.objects_served()
+			+ _entry_pool.links.objects_served()
+			+ _backtrace_pool.objects_served());
 }
 
 // ------------------------------------------------------------------
 void* manager::allocate_memory(size_t size, bool is_array)
 	DEREFEREE_THROW_BAD_ALLOC
 {
-	size_t alloc_size = size + (2 * DEREFEREE_SAFETY_SIZE);
+	size_t alloc_size = size + (2 * _safety_size);
 
 	// Check for overflow after we add the safety size to the buffer.
 	if(alloc_size < size)
@@ -598,24 +1441,56 @@ void* manager::allocate_memory(size_t size, bool is_array)
 
 	_usage_stats.record_allocation(size, is_array);
 
-	char* client_ptr = address + DEREFEREE_SAFETY_SIZE;
+	char* client_ptr = address + _safety_size;
 
-	memset(address, DEREFEREE_SAFETY_CHAR, DEREFEREE_SAFETY_SIZE);
-	memset(client_ptr + size, DEREFEREE_SAFETY_CHAR, DEREFEREE_SAFETY_SIZE);
+	memset(address, DEREFEREE_SAFETY_CHAR, _safety_size);
+	memset(client_ptr + size, DEREFEREE_SAFETY_CHAR, _safety_size);
 
-	memtab_entry* new_node = memtab_alloc();
+	memtab_entry* new_node = memtab_alloc(_entry_pool);
+	if(!new_node)
+	{
+		free(address);
+		throw(std::bad_alloc());
+	}
 
-	new_node->info.address = client_ptr;
-	new_node->info.is_array = is_array;
-	new_node->info.block_size = size;
-	new_node->info.tag = next_tag();
-	new_node->info.ref_count = 0;
-	new_node->info.backtrace = _platform->get_backtrace(NULL, NULL);
-    new_node->info.user_info = _listener->get_allocation_user_info(
-        allocation_info_impl(new_node->info));
+	new_node->info->address = client_ptr;
+	new_node->info->is_array = is_array;
+	new_node->info->block_size = size;
+	atomic_store_memtag(new_node->info->tag, next_tag());
+	new_node->info->ref_count = 0;
+
+	// Only the identifier of the backtrace is kept with the block, so the
+	// platform's copy can be released as soon as it has been interned.
+	void** backtrace = _platform->get_backtrace(NULL, NULL);
+	new_node->info->backtrace = intern_backtrace(backtrace);
+	_platform->free_backtrace(backtrace);
+
+    new_node->info->user_info = _listener->get_allocation_user_info(
+        allocation_info_impl(*new_node->info));
+
+	memtab_shard& shard = home_shard(client_ptr, size);
+	shard.lock.lock();
+	bool inserted = memtab_insert_entry(_entry_pool, shard.root, shard.pages,
+		new_node);
+	if(inserted)
+		_unchecked_count.add(1);
+	shard.lock.unlock();
+
+	if(!inserted)
+	{
+		allocation_info_impl aii(*new_node->info);
+		_listener->free_allocation_user_info(aii);
+
+		memtab_free(_entry_pool, new_node);
+		free(address);
+		throw(std::bad_alloc());
+	}
 
-	memtab_insert_entry(_unchecked_table, new_node);
-	_unchecked_table_size++;
+	if(_safety_scan_interval > 0 &&
+		_allocations_since_start.add(1) % _safety_scan_interval == 0)
+	{
+		scan_safety_zones();
+	}
 
 	return client_ptr;
 }
@@ -636,85 +1511,107 @@ void manager::free_memory(void* address, bool is_array)
 	}
 	else if(address != 0)
 	{
-		bool is_checked;
-		mem_info* addr_info = address_info(address, &is_checked);
+		mem_info tombstone;
+		take_result taken = take_entry(address, is_array, false, tombstone);
 
-		if(!addr_info)
+		if(taken == take_wrong_form)
 		{
+			// The block stays in the table while the error is reported, in
+			// case the listener does not return. If it does, the block is
+			// freed anyway.
 			if(is_array)
 			{
-				error(error_array_delete_dead_deleted);
+				error(error_array_delete_on_non_array);
 			}
 			else
 			{
-				error(error_nonarray_delete_dead_deleted);
+				error(error_nonarray_delete_on_array);
 			}
+
+			taken = take_entry(address, is_array, true, tombstone);
 		}
-		else
+
+		if(taken == take_not_found)
 		{
-			if(!is_array && addr_info->is_array)
+			bool quarantined = false;
+
+			if(_quarantine.capacity() > 0)
 			{
-				error(error_nonarray_delete_on_array);
+				scoped_lock lock(_quarantine_lock);
+
+				const mem_info* info = _quarantine.find_address(address);
+				if(info)
+				{
+					tombstone = *info;
+					quarantined = true;
+				}
 			}
-			else if(is_array && !addr_info->is_array)
+
+			if(quarantined)
+				describe_deleted_block(tombstone);
+
+			if(is_array)
 			{
-				error(error_array_delete_on_non_array);
+				error(error_array_delete_dead_deleted);
 			}
-
-			size_t size = addr_info->block_size;
+			else
+			{
+				error(error_nonarray_delete_dead_deleted);
+			}
+		}
+		else
+		{
+			size_t size = tombstone.block_size;
 
 			_usage_stats.record_deallocation(size, is_array);
 
-            allocation_info_impl aii(*addr_info);
+            allocation_info_impl aii(tombstone);
             _listener->free_allocation_user_info(aii);
 
-			_platform->free_backtrace(addr_info->backtrace);
-
-			if(is_checked)
-				remove_checked(address);
-			else
-				remove_unchecked(address);
-
-			char* block_start = (char*)address - DEREFEREE_SAFETY_SIZE;
-			char* client_end = (char*)address + size;
-
-			char safety_check[DEREFEREE_SAFETY_SIZE];
-			bool low_damage = false, high_damage = false;
-
-			memset(safety_check, DEREFEREE_SAFETY_CHAR, DEREFEREE_SAFETY_SIZE);
-
-			if(memcmp(block_start, safety_check, DEREFEREE_SAFETY_SIZE))
-				low_damage = true;
+			tombstone.user_info = NULL;
 
-			if(memcmp(client_end, safety_check, DEREFEREE_SAFETY_SIZE))
-				high_damage = true;
+			char* block_start = (char*)address - _safety_size;
+			int damage = check_safety_zones(address, size, _safety_size);
 
-			if(low_damage || high_damage)
+			if(damage != memory_corruption_none)
 			{
-				memory_corruption_location damage_type;
-
-				if(low_damage && high_damage)
-				{
-					damage_type = memory_corruption_both;
-				}
-				else if(low_damage)
-				{
-					damage_type = memory_corruption_before;
-				}
-				else
-				{
-					damage_type = memory_corruption_after;
-				}
-
-				warning(warning_memory_boundary_corrupted, damage_type);
+				warning(warning_memory_boundary_corrupted,
+					(memory_corruption_location)damage);
 			}
 
 			// Zero out the memory before freeing it. This is useful if a
 			// dangling pointer to an object with a vtable has a method
 			// called on it; in this case, a null pointer dereference
-			// will result.
-			memset(block_start, 0, size + 2 * DEREFEREE_SAFETY_SIZE);
-			free(block_start);
+			// will result. In the "prefix" poisoning mode only the start
+			// of the block, where the vtable pointer is, gets zeroed.
+			if(_poison_prefix == DEREFEREE_POISON_ALL)
+			{
+				memset(block_start, 0, size + 2 * _safety_size);
+			}
+			else
+			{
+				memset(address, 0,
+					(size < _poison_prefix) ? size : _poison_prefix);
+			}
+
+			if(_quarantine.capacity() > 0)
+			{
+				void* evicted_block;
+				mem_info evicted_info;
+				bool evicted;
+
+				_quarantine_lock.lock();
+				evicted = _quarantine.add(block_start, tombstone,
+					evicted_block, evicted_info);
+				_quarantine_lock.unlock();
+
+				if(evicted)
+					release_block(evicted_block, evicted_info);
+			}
+			else
+			{
+				free(block_start);
+			}
 		}
 	}
 	else
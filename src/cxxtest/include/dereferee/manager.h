@@ -28,7 +28,12 @@
 #include <dereferee/option.h>
 #include <dereferee/platform.h>
 #include <dereferee/listener.h>
+#include <dereferee/arena.h>
+#include <dereferee/threads.h>
 #include <dereferee/memtab.h>
+#include <dereferee/quarantine.h>
+#include <dereferee/type_names.h>
+#include <dereferee/backtrace_table.h>
 #include <dereferee/cookie_calculator.h>
 #include <dereferee/bounds_checker.h>
 #include <dereferee/usage_stats_impl.h>
@@ -40,12 +45,37 @@
 namespace Dereferee
 {
 
+/**
+ * The number of shards into which the memory table is split. Blocks smaller
+ * than the region size are kept in the shard selected by the region of the
+ * address space in which they start, so a block never spans more than two
+ * regions; larger blocks are kept in one extra shard of their own.
+ */
+#define DEREFEREE_MEMTAB_SHARDS 16
+
+/**
+ * The base-2 logarithm of the size of each region of the address space used
+ * to select a block's shard.
+ */
+#define DEREFEREE_MEMTAB_REGION_SHIFT 20
+
+/**
+ * The number of tags that a thread reserves from the shared tag counter at a
+ * time.
+ */
+#define DEREFEREE_TAG_BLOCK_SIZE 64
+
+
 /**
  * Forward declarations to satisfy Microsoft Visual C++.
  */
 Dereferee::platform* current_platform();
 Dereferee::listener* current_listener();
+void** allocate_backtrace_array(size_t entries);
+void free_backtrace_array(void** backtrace);
 void visit_allocations(Dereferee::allocation_visitor visitor, void* arg);
+bool visit_allocations_while(Dereferee::allocation_visitor_while visitor,
+	void* arg);
 
 
 // ============================================================================
@@ -53,6 +83,10 @@ void visit_allocations(Dereferee::allocation_visitor visitor, void* arg);
  * The Dereferee memory manager class is not intended to be used directly
  * by client code. Its methods are only called by the checked_ptr class and
  * related code to manage memory used throughout the execution of a program.
+ *
+ * When DEREFEREE_THREAD_SAFE is defined, the manager can be used from
+ * several threads at once. No lock is held while the listener is notified
+ * of an error or warning, since the listener may not return.
  */
 class manager
 {
@@ -63,9 +97,15 @@ private:
 	static manager* _instance;
 
 	/**
-	 * Keeps track of the next unique pointer tag.
+	 * Protects the creation of the singleton instance.
+	 */
+	static mutex _instance_lock;
+
+	/**
+	 * Keeps track of the next unique pointer tag that has not been reserved
+	 * by a thread.
 	 */
-	memtag_t _next_tag;
+	atomic_counter _next_tag;
 
 	/**
 	 * A unique block of memory allocated to flag checked pointers as
@@ -77,30 +117,25 @@ private:
 	void* _uninit_handle;
 
 	/**
-	 * A table that keeps track of memory blocks that have moved into a checked
-	 * context (that is, once allocated, they have been assigned to a checked
-	 * pointer).
-	 */
-	memtab_entry* _checked_table;
-
-	/**
-	 * A table that keeps track of memory blocks that are still unchecked (that
-	 * is, have been allocated but have not yet been assigned to a checked
-	 * pointer).
+	 * A table that keeps track of all currently allocated memory blocks,
+	 * split into shards by address (see DEREFEREE_MEMTAB_SHARDS), each with
+	 * its own lock. The is_checked flag of each entry indicates whether the
+	 * block has moved into a checked context (that is, once allocated, it
+	 * has been assigned to a checked pointer) or is still unchecked.
 	 */
-	memtab_entry* _unchecked_table;
+	memtab_shard _shards[DEREFEREE_MEMTAB_SHARDS + 1];
 
 	/**
 	 * The number of currently allocated blocks of memory that are assigned
 	 * to checked pointers.
 	 */
-	size_t _checked_table_size;
+	atomic_counter _checked_count;
 
 	/**
 	 * The number of currently allocated blocks of memory that have not yet
 	 * been assigned to checked pointers.
 	 */
-	size_t _unchecked_table_size;
+	atomic_counter _unchecked_count;
 	
 	/**
 	 * A pointer to a platform object that is used to acquire platform-
@@ -120,6 +155,57 @@ private:
 	 */
 	usage_stats_impl _usage_stats;
 
+	/**
+	 * The slab allocators from which the entries in the memory table are
+	 * allocated. Every entry is released along with them when the manager is
+	 * destroyed.
+	 */
+	memtab_pool _entry_pool;
+
+	/**
+	 * The pool from which the platform allocates the backtraces that are
+	 * saved with each block of memory. Every backtrace is released along
+	 * with it when the manager is destroyed.
+	 */
+	backtrace_pool _backtrace_pool;
+
+	/**
+	 * Holds deleted blocks of memory out of circulation, along with a
+	 * tombstone describing each one, for as many blocks as the listener
+	 * requests.
+	 */
+	quarantine _quarantine;
+
+	/**
+	 * Protects the quarantine.
+	 */
+	mutex _quarantine_lock;
+
+	/**
+	 * The number of bytes of the safety zone placed before and after each
+	 * block of memory.
+	 */
+	size_t _safety_size;
+
+	/**
+	 * The number of allocations between scans of every block's safety
+	 * zones, or 0 if the zones are only checked when a block is deleted.
+	 */
+	size_t _safety_scan_interval;
+
+	/**
+	 * The number of allocations made, used to decide when to scan the
+	 * safety zones.
+	 */
+	atomic_counter _allocations_since_start;
+
+	/**
+	 * The number of bytes at the beginning of each block that are zeroed
+	 * when it is deleted, or DEREFEREE_POISON_ALL to zero the whole block
+	 * and its safety zones.
+	 */
+	size_t _poison_prefix;
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Initializes the memory manager object.
@@ -129,24 +215,129 @@ private:
 	// -----------------------------------------------------------------------
 	/**
 	 * Returns the next unique tag (up to 2^32 - 1) for memory address
-	 * reuse tracking.
+	 * reuse tracking. Each thread hands out tags from a block that it
+	 * reserves from the shared counter, so no lock is needed; a program with
+	 * a single thread still receives consecutive tags.
 	 */
 	memtag_t next_tag();
 
 	// -----------------------------------------------------------------------
 	/**
-	 * Counts the number of links in the memory allocation table.  Called when
-	 * execution is complete to report memory leaks.
+	 * Returns the shard of the memory table that holds, or will hold, the
+	 * block with the specified address and size.
+	 */
+	memtab_shard& home_shard(const void* address, size_t size);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the entry of the memory table whose block contains the
+	 * specified address, and locks the shard that holds it.
+	 *
+	 * @param address the address to search for
+	 * @param entry set to the entry that was found, or NULL
+	 * @returns the locked shard, which the caller must unlock, or NULL if no
+	 *     block contains the address (in which case no shard is locked)
+	 */
+	memtab_shard* lock_entry(const void* address, memtab_entry*& entry);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the information about the block that contains the specified
+	 * address, or NULL if no block contains it.
 	 */
-	void count_leaked_entries(memtab_entry* entry, size_t& reports_logged);
+	mem_info* find_info(const void* address);
 
 	// -----------------------------------------------------------------------
 	/**
-	 * Displays the contents of the memory allocation table.  Called when
-	 * execution is complete to report memory leaks.
+	 * Removes the block at the specified address from the memory table if
+	 * its is_checked flag matches the specified value.
+	 *
+	 * @returns true if the block was removed
+	 */
+	bool remove_entry(const void* address, bool checked);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * The outcomes of take_entry.
 	 */
-	void report_leaked_entry(memtab_entry* entry, size_t max_log,
-							 size_t& reports_logged);
+	enum take_result
+	{
+		take_not_found,
+		take_wrong_form,
+		take_removed
+	};
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the block that contains the specified address and removes it
+	 * from the memory table, holding the lock on its shard for both steps
+	 * so that another thread cannot free the block in between. Unless force
+	 * is true, a block that was allocated with a different form of new than
+	 * is_array indicates is left in the table.
+	 *
+	 * @param address the address being deleted
+	 * @param is_array true if the address is being deleted with delete[]
+	 * @param force true to remove the block whichever form allocated it
+	 * @param info set to a copy of the block's information if it was found
+	 * @returns whether the block was found, and if so, whether it was removed
+	 */
+	take_result take_entry(const void* address, bool is_array, bool force,
+		mem_info& info);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Locks every shard of the memory table, in order.
+	 */
+	void lock_all_shards();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Unlocks every shard of the memory table, in the reverse order.
+	 */
+	void unlock_all_shards();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * The signature of a function that walk_allocations calls on each
+	 * block. It returns true to continue on to the next block, or false to
+	 * stop.
+	 */
+	typedef bool (*entry_visitor)(mem_info& info, void* arg);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Calls the specified function on every block in the memory table, in
+	 * order of address, until it returns false. The shards are walked side
+	 * by side without recursion or a copy of the table, so blocks are
+	 * visited in the same order no matter how they are spread across the
+	 * shards. The caller must hold the lock of every shard.
+	 *
+	 * @returns true if every block was visited, or false if the function
+	 *     stopped early
+	 */
+	bool walk_allocations(entry_visitor visitor, void* arg);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Checks the safety zones of every allocated block and issues a warning
+	 * for the first block found to be damaged. The zones of that block are
+	 * repaired so that the damage is reported only once.
+	 */
+	void scan_safety_zones();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a block of memory to the system. Used when a deleted block
+	 * leaves the quarantine.
+	 */
+	void release_block(void* block, mem_info& info);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Passes the tombstone of a quarantined block to the listener so that it
+	 * can describe the deleted block in the error that follows.
+	 */
+	void describe_deleted_block(const mem_info& tombstone);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -156,6 +347,30 @@ private:
 	 */ 
 	void initialize_platform();
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Applies the platform options that are interpreted by the memory manager
+	 * itself rather than by the platform object. These are:
+	 *
+	 * - "memtab.index": "tree" (the default) to find memory blocks by
+	 *   searching the balanced tree, or "pages" to find them through a page
+	 *   directory in constant time
+	 * - "safety.size": the number of bytes of the safety zone placed before
+	 *   and after each block to detect overruns, rounded up to a multiple of
+	 *   DEREFEREE_SAFETY_ALIGNMENT (16 by default; 0 disables the zones)
+	 * - "safety.scan.interval": if nonzero, the safety zones of every
+	 *   allocated block are checked after this many allocations, so that an
+	 *   overrun is reported before the damaged block is deleted (0 by
+	 *   default)
+	 * - "free.poison": "full" (the default) to zero each block and its
+	 *   safety zones when it is deleted, or "prefix" to zero only the
+	 *   beginning of the block, which is where an object's vtable pointer
+	 *   lives, so that deleting large arrays costs less
+	 * - "free.poison.prefix": the number of bytes zeroed at the beginning of
+	 *   each block in "prefix" mode (DEREFEREE_POISON_PREFIX by default)
+	 */
+	void apply_platform_options(const option* options);
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Parses any listener options specified at compile-time (as a
@@ -172,14 +387,6 @@ private:
 	void add_option(option*& options, size_t& num_options,
 			size_t& cap_options, const char* key, const char* value);
 
-	// -----------------------------------------------------------------------
-	/**
-	 * A recursive helper function that handles the visitation of allocated
-	 * memory blocks.
-	 */
-    void visit_allocation_entry(memtab_entry* entry,
-                                allocation_visitor visitor, void* arg);
-
 public:
 	// -----------------------------------------------------------------------
 	/**
@@ -211,15 +418,41 @@ public:
 
 	// -----------------------------------------------------------------------
 	/**
-	 * Returns a value indicating whether the assigned pointer table contains
-	 * the specified address and tag; that is, whether the memory address is
-	 * live.
+	 * Returns a value indicating whether the memory table contains a checked
+	 * block with the specified address and tag; that is, whether the memory
+	 * address is live.
 	 * 
 	 * @param address the memory address to check
 	 * @param tag the unique tag associated with the pointer
 	 * @returns true if the address is live; otherwise, false.
 	 */
 	bool is_checked(const void* address, memtag_t tag);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the information about the live checked block with the
+	 * specified tag that contains the specified address. The hint is checked
+	 * first and returned directly if it still describes such a block, which
+	 * avoids searching the memory table; otherwise the table is searched and
+	 * the hint is updated with the result.
+	 *
+	 * This relies on each mem_info in the memory table being cleared when it
+	 * is freed, on a block's mem_info staying at the same address while the
+	 * block is allocated, and on the mem_info records remaining addressable
+	 * for as long as the manager exists (they are allocated from slabs that
+	 * are only released when it is destroyed). The hint is checked without
+	 * locking the table. A tag that belongs to a quarantined block is
+	 * recognized as dead without searching the table.
+	 *
+	 * @param address the memory address to check
+	 * @param tag the unique tag associated with the pointer
+	 * @param hint the mem_info found by a previous call, or NULL; updated to
+	 *     the value returned
+	 * @returns the information about the block if the address is live;
+	 *     otherwise, NULL
+	 */
+	mem_info* checked_info(const void* address, memtag_t tag,
+		mem_info*& hint);
 	
 	// -----------------------------------------------------------------------
 	/**
@@ -263,12 +496,27 @@ public:
 	// -----------------------------------------------------------------------
     /**
      * Calls the specified visitor function on every currently allocated block
-     * of memory.
+     * of memory, in order of address. The memory table is locked while this
+     * is running, so the visitor must not allocate or free memory.
      *
      * @param visitor the visitor function to invoke
      */
     void visit_allocations(allocation_visitor visitor, void* arg);
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Calls the specified visitor function on the currently allocated blocks
+	 * of memory, in order of address, until it returns false. The memory
+	 * table is locked while this is running, so the visitor must not
+	 * allocate or free memory.
+	 *
+	 * @param visitor the visitor function to invoke
+	 * @returns true if every block was visited, or false if the visitor
+	 *     stopped early
+	 */
+	bool visit_allocations_while(allocation_visitor_while visitor,
+		void* arg);
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Gets descriptive information about the memory block that contains the
@@ -315,9 +563,10 @@ public:
 
 	// -----------------------------------------------------------------------
 	/**
-	 * Moves a currently unchecked memory address to the checked pointer
-	 * table. This method is called by the checked_ptr class the first time
-	 * that a raw pointer is assigned to a checked pointer.
+	 * Marks a currently unchecked memory address as checked. This method is
+	 * called by the checked_ptr class the first time that a raw pointer is
+	 * assigned to a checked pointer. An address that is already checked is
+	 * left as it is.
 	 * 
 	 * @param address the memory address to move
 	 * @returns the unique tag associated with this address
@@ -326,7 +575,7 @@ public:
 	
 	// -----------------------------------------------------------------------
 	/**
-	 * Removes a memory address from the unchecked pointer table. This is
+	 * Removes an unchecked memory address from the memory table. This is
 	 * called by the overloaded delete operators in order to remove any
 	 * references to memory addresses that may have been allocated but never
 	 * assigned to a checked pointer object.
@@ -337,7 +586,7 @@ public:
 
 	// -----------------------------------------------------------------------
 	/**
-	 * Removes a memory address from the checked pointer table. This is called
+	 * Removes a checked memory address from the memory table. This is called
 	 * by the checked pointer class when the final reference to a memory
 	 * address is released.
 	 * 
@@ -351,6 +600,17 @@ public:
 	 */
 	void error(error_code code, ...);
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Logs a pointer error caused by the use of a dead pointer whose memory
+	 * has been deleted. If the block is still in quarantine, the listener is
+	 * first given a description of the block.
+	 *
+	 * @param code the error code
+	 * @param tag the unique tag associated with the dead pointer
+	 */
+	void deleted_pointer_error(error_code code, memtag_t tag);
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Logs a pointer warning to the listener.
@@ -364,16 +624,56 @@ public:
 	 */
 	void report_usage();
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Reports each leaked block to the listener.
+	 */
+	void report_usage_by_leak();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Reports the leaked blocks to the listener grouped by the site where
+	 * they were allocated.
+	 *
+	 * @returns true if the report was made; false if there was not enough
+	 *     memory to group the leaks, in which case nothing was reported
+	 */
+	bool report_usage_by_site();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Brings the usage statistics up to date before they are passed to the
+	 * listener at the start of a report.
+	 *
+	 * @param leaks the number of leaks that were found
+	 */
+	void finish_usage_stats(size_t leaks);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Passes the distinct frames in the backtraces of the blocks that are
+	 * about to be reported to the platform, so that it can resolve them all
+	 * at once.
+	 *
+	 * @param reports the blocks that will be reported
+	 * @param count the number of blocks
+	 */
+	void prepare_backtraces(mem_info** reports, size_t count);
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Friend declaration of the helper functions declared in <dereferee.h>
-	 * so that their implementations can access the private _platform and
-	 * _listener fields.
+	 * and <dereferee/platform.h> so that their implementations can access
+	 * the private _platform, _listener, and _backtrace_pool fields.
 	 */
 	friend platform* Dereferee::current_platform();
 	friend listener* Dereferee::current_listener();
+	friend void** Dereferee::allocate_backtrace_array(size_t entries);
+	friend void Dereferee::free_backtrace_array(void** backtrace);
     friend void Dereferee::visit_allocations(allocation_visitor visitor,
                                              void* arg);
+	friend bool Dereferee::visit_allocations_while(
+		allocation_visitor_while visitor, void* arg);
 
 	// -----------------------------------------------------------------------
 	/**
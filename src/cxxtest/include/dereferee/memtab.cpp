@@ -17,6 +17,9 @@
  */
 
 #include <memory>
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
 #include <dereferee/memtab.h>
 
 // ===========================================================================
@@ -24,6 +27,24 @@
 namespace Dereferee
 {
 
+// ---------------------------------------------------------------------------
+/**
+ * Resets a mem_info to default values. A checked pointer may still be
+ * reading a mem_info that was freed and is now being reused, so the tag is
+ * only ever changed with an atomic store and is never zeroed along with the
+ * other fields.
+ */
+static void memtab_clear_info(mem_info* info)
+{
+	char* bytes = (char*)info;
+	size_t tag_start = offsetof(mem_info, tag);
+	size_t tag_end = tag_start + sizeof(memtag_t);
+
+	memset(bytes, 0, tag_start);
+	memset(bytes + tag_end, 0, sizeof(mem_info) - tag_end);
+	atomic_store_memtag(info->tag, default_memtag);
+}
+
 bool memtab_impl_1(memtab_entry*&, memtab_entry*, memtab_entry*); bool
 memtab_impl_2(memtab_entry*&, const void*, bool&, memtab_entry*&); bool
 memtab_impl_3(memtab_entry*&); bool memtab_impl_4(memtab_entry*&); bool
@@ -31,34 +52,40 @@ memtab_impl_5(memtab_entry*&); bool memtab_impl_6(memtab_entry*&); void
 memtab_impl_7(memtab_entry*&); void memtab_impl_8(memtab_entry*&); bool
 memtab_impl_9(memtab_entry*, memtab_entry*&, bool&, memtab_entry*&); bool
 memtab_impl_10(memtab_entry*, memtab_entry*&, bool&, memtab_entry*&);
-memtab_entry* memtab_alloc() { memtab_entry* entry = (memtab_entry*)malloc(
-sizeof(memtab_entry)); entry->_1 = entry->_2 = entry->_0 = 0; entry->_3 = 0;
-memset(&entry->info, 0, sizeof(mem_info)); entry->info.tag = (unsigned long)~0;
-return entry; } void memtab_free(memtab_entry* entry) { if(
-entry->info.type_name) free( entry->info.type_name); free(entry); } void
-memtab_destroy_table(memtab_entry* entry) { if(entry) { memtab_destroy_table(
-entry->_1); memtab_destroy_table(entry->_2); memtab_free(entry); } }
-memtab_entry* memtab_find_address(memtab_entry* entry, const void* address) {
-if(!entry) return 0; else if(entry->info.address <= address && address <=
-(char*)entry->info.address + entry->info.block_size) return entry; else if(
-address < entry->info.address) return memtab_find_address(entry->_1, address);
-else return memtab_find_address(entry->_2, address); } bool memtab_insert_entry(
+memtab_entry* memtab_alloc(memtab_pool& pool) { memtab_entry* entry = (
+memtab_entry*)pool.entries.allocate(); if(!entry) return 0; mem_info* info = (
+mem_info*)pool.infos.allocate(); if(!info) { pool.entries.release(entry); return
+0; } entry->_1 = entry->_2 = entry->_0 = 0; entry->_3 = 0;
+memtab_clear_info(info); entry->info = info; return entry; } void memtab_free(
+memtab_pool& pool, memtab_entry* entry) {
+atomic_store_memtag(entry->info->tag, default_memtag); entry->info->is_checked
+= false;
+pool.infos.release(
+entry->info); pool.entries.release(entry); }
+void memtab_tree_destroy(memtab_pool& pool, memtab_entry* entry) { if(entry)
+{ memtab_tree_destroy(pool, entry->_1); memtab_tree_destroy(pool, entry->_2);
+memtab_free(pool, entry); } }
+memtab_entry* memtab_tree_find(memtab_entry* entry, const void* address) {
+if(!entry) return 0; else if(entry->info->address <= address && address <=
+(char*)entry->info->address + entry->info->block_size) return entry; else if(
+address < entry->info->address) return memtab_tree_find(entry->_1, address);
+else return memtab_tree_find(entry->_2, address); } bool memtab_tree_insert(
 memtab_entry*& _a1, memtab_entry* _a2) { return memtab_impl_1(_a1, 0, _a2); }
-memtab_entry* memtab_remove_address(memtab_entry*& entry, const void* address) {
+memtab_entry* memtab_tree_remove(memtab_entry*& entry, const void* address) {
 memtab_entry* _a4 = 0; bool _a3 = false; memtab_impl_2(entry, address, _a3,
 _a4); return _a4; } bool memtab_impl_1(memtab_entry*& _a1, memtab_entry* _a2,
 memtab_entry* _a3) { if(!_a1) { _a1 = _a3; _a3->_0 = _a2; return true; } else {
-bool _lr; if(_a3->info.address < _a1->info.address) { _lr = memtab_impl_1(
+bool _lr; if(_a3->info->address < _a1->info->address) { _lr = memtab_impl_1(
 _a1->_1, _a1, _a3); if(_lr) _lr = memtab_impl_3(_a1); } else { _lr =
 memtab_impl_1(_a1->_2, _a1, _a3); if(_lr) _lr = memtab_impl_4(_a1); } return
 _lr; } } bool memtab_impl_2(memtab_entry*& _a1, const void* _a2, bool& _a3,
 memtab_entry*& _a4) { if(!_a1) { _a3 = false; _a4 = 0; return false; } else {
-bool _lr = false; if(_a1->info.address <= _a2 && _a2 <= (char*)_a1->info.address
-+ _a1->info.block_size) { _a3 = true; if(_a1->_1) { _lr = memtab_impl_10(_a1,
+bool _lr = false; if(_a1->info->address <= _a2 && _a2 <= (char*)_a1->info->address
++ _a1->info->block_size) { _a3 = true; if(_a1->_1) { _lr = memtab_impl_10(_a1,
 _a1->_1, _a3, _a4); if(_a3 && _lr) _lr = memtab_impl_5(_a1); } else if(_a1->_2)
 { _lr = memtab_impl_9(_a1, _a1->_2, _a3, _a4); if(_a3 && _lr) _lr =
 memtab_impl_6(_a1); } else { _a4 = _a1; _a4->_1 = _a4->_2 = _a4->_0 = 0;
-_a1 = 0; _lr = true; } } else if(_a2 < _a1->info.address) { _lr =
+_a1 = 0; _lr = true; } } else if(_a2 < _a1->info->address) { _lr =
 memtab_impl_2(_a1->_1, _a2, _a3, _a4); if(_lr) _lr = memtab_impl_5(_a1); } else
 { _lr = memtab_impl_2(_a1->_2, _a2, _a3, _a4); if(_lr) _lr = memtab_impl_6(_a1);
 } return _lr; } } bool memtab_impl_3(memtab_entry*& _a1) { bool _lr = false;
@@ -100,14 +127,529 @@ temp; _a1->_0 = temp->_0; temp->_0 = _a1; if(temp->_1) temp->_1->_0 = _a1->_2;
 } bool memtab_impl_9(memtab_entry* _a1, memtab_entry*& _a2, bool& _a3,
 memtab_entry*& _a4) { bool _lr = true; if(!_a2) _a3 = false; else { if(_a2->_1)
 { _lr = memtab_impl_9(_a1, _a2->_1, _a3, _a4); if(_a3 && _lr)
-_lr = memtab_impl_5(_a2); } else { mem_info temp = _a1->info;
+_lr = memtab_impl_5(_a2); } else { mem_info* temp = _a1->info;
 _a1->info = _a2->info; _a2->info = temp; _a4 = _a2; _a2 = _a4->_2; if(_a2)
 _a2->_0 = _a4->_0; _a4->_1 = _a4->_2 = _a4->_0 = 0; _a3 = true; } } return _lr;	
 } bool memtab_impl_10(memtab_entry* _a1, memtab_entry*& _a2, bool& _a3,
 memtab_entry*& _a4) { bool _lr = true; if(!_a2) _a3 = false; else { if(_a2->_2)
 { _lr = memtab_impl_10(_a1, _a2->_2, _a3, _a4); if(_a3 && _lr)
-_lr = memtab_impl_6(_a2); } else { mem_info temp = _a1->info; _a1->info =
+_lr = memtab_impl_6(_a2); } else { mem_info* temp = _a1->info; _a1->info =
 _a2->info; _a2->info = temp; _a4 = _a2; _a2 = _a4->_1; if(_a2) _a2->_0 =
 _a4->_0; _a4->_1 = _a4->_2 = _a4->_0 = 0; _a3 = true; } } return _lr; }
 
+// ===========================================================================
+/*
+ * Removal of a particular entry from the tree. Unlike memtab_tree_remove,
+ * which removes whichever entry's block the search for an address reaches
+ * first, this descends by the entry's own address and matches the entry
+ * itself, so that it cannot pick a neighbor whose one-past-the-end address
+ * is the same as the entry's start. The rebalancing is the same as above.
+ */
+
+// ---------------------------------------------------------------------------
+static bool memtab_tree_unlink(memtab_entry*& node, memtab_entry* target,
+							   bool& found, memtab_entry*& removed)
+{
+	if(!node)
+	{
+		found = false;
+		removed = 0;
+		return false;
+	}
+
+	bool shrunk = false;
+
+	if(node == target)
+	{
+		found = true;
+
+		if(node->_1)
+		{
+			shrunk = memtab_impl_10(node, node->_1, found, removed);
+			if(found && shrunk)
+				shrunk = memtab_impl_5(node);
+		}
+		else if(node->_2)
+		{
+			shrunk = memtab_impl_9(node, node->_2, found, removed);
+			if(found && shrunk)
+				shrunk = memtab_impl_6(node);
+		}
+		else
+		{
+			removed = node;
+			removed->_1 = removed->_2 = removed->_0 = 0;
+			node = 0;
+			shrunk = true;
+		}
+	}
+	else if(target->info->address < node->info->address)
+	{
+		shrunk = memtab_tree_unlink(node->_1, target, found, removed);
+		if(shrunk)
+			shrunk = memtab_impl_5(node);
+	}
+	else
+	{
+		shrunk = memtab_tree_unlink(node->_2, target, found, removed);
+		if(shrunk)
+			shrunk = memtab_impl_6(node);
+	}
+
+	return shrunk;
+}
+
+// ---------------------------------------------------------------------------
+static memtab_entry* memtab_tree_remove_entry(memtab_entry*& entry,
+											  memtab_entry* target)
+{
+	memtab_entry* removed = 0;
+	bool found = false;
+	memtab_tree_unlink(entry, target, found, removed);
+	return removed;
+}
+
+
+// ===========================================================================
+/*
+ * The page index. The address space is divided into pages of 2^PAGE_SHIFT
+ * bytes, and pages are grouped into leaves of 2^LEAF_BITS pages each. A
+ * hashed directory maps the high bits of an address to its leaf, and each
+ * slot in a leaf holds a short list of the entries whose blocks start or end
+ * on that page (counting the one-past-the-end address, which the tree search
+ * also treats as part of the block). Finding the entry for an address is
+ * then a directory probe, an array index, and a scan of a list that is
+ * almost always one or two links long.
+ *
+ * Only the first and last pages of a block are indexed, so that a large
+ * block costs no more to insert than a small one. An address on one of the
+ * pages in between is not found in its slot, and is looked up in the tree
+ * instead.
+ *
+ * Each table has a directory of its own, which is only used while the
+ * caller holds the lock on the table, so lookups in different shards of the
+ * memory manager's table never wait for each other.
+ *
+ * Since the AVL removal above swaps the info pointer of the removed node
+ * with that of its in-order neighbor, the index has to be repointed whenever
+ * an entry changes nodes; see memtab_remove_entry.
+ */
+
+static const unsigned PAGE_SHIFT = 12;
+static const unsigned LEAF_BITS = 10;
+static const size_t PAGES_PER_LEAF = (size_t)1 << LEAF_BITS;
+static const size_t INITIAL_DIRECTORY_CAPACITY = 64;
+
+struct memtab_page_leaf
+{
+	uintptr_t key;
+	memtab_page_link* pages[PAGES_PER_LEAF];
+};
+
+static memtab_index_mode index_mode = memtab_index_tree;
+
+// ---------------------------------------------------------------------------
+static size_t directory_hash(uintptr_t key, size_t capacity)
+{
+	// Fibonacci hashing; the capacity is always a power of two.
+	return (size_t)((key * (uintptr_t)0x9E3779B97F4A7C15ULL) >> 7)
+		& (capacity - 1);
+}
+
+// ---------------------------------------------------------------------------
+static bool directory_grow(memtab_page_directory& directory)
+{
+	size_t new_capacity = directory.capacity ?
+		directory.capacity * 2 : INITIAL_DIRECTORY_CAPACITY;
+	memtab_page_leaf** new_slots = (memtab_page_leaf**)calloc(new_capacity,
+		sizeof(memtab_page_leaf*));
+
+	if(!new_slots)
+		return false;
+
+	for(size_t i = 0; i < directory.capacity; i++)
+	{
+		memtab_page_leaf* leaf = directory.slots[i];
+		if(leaf)
+		{
+			size_t j = directory_hash(leaf->key, new_capacity);
+			while(new_slots[j])
+				j = (j + 1) & (new_capacity - 1);
+
+			new_slots[j] = leaf;
+		}
+	}
+
+	free(directory.slots);
+	directory.slots = new_slots;
+	directory.capacity = new_capacity;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+static memtab_page_leaf* directory_leaf(
+	const memtab_page_directory& directory, uintptr_t key)
+{
+	if(directory.capacity)
+	{
+		size_t i = directory_hash(key, directory.capacity);
+		while(directory.slots[i])
+		{
+			if(directory.slots[i]->key == key)
+				return directory.slots[i];
+
+			i = (i + 1) & (directory.capacity - 1);
+		}
+	}
+
+	return 0;
+}
+
+// ---------------------------------------------------------------------------
+static memtab_page_leaf* directory_add_leaf(memtab_page_directory& directory,
+											uintptr_t key)
+{
+	memtab_page_leaf* leaf = directory_leaf(directory, key);
+	if(leaf)
+		return leaf;
+
+	if(2 * (directory.count + 1) > directory.capacity &&
+	   !directory_grow(directory))
+	{
+		return 0;
+	}
+
+	leaf = (memtab_page_leaf*)calloc(1, sizeof(memtab_page_leaf));
+	if(!leaf)
+		return 0;
+
+	leaf->key = key;
+
+	size_t i = directory_hash(key, directory.capacity);
+	while(directory.slots[i])
+		i = (i + 1) & (directory.capacity - 1);
+
+	directory.slots[i] = leaf;
+	directory.count++;
+
+	return leaf;
+}
+
+// ---------------------------------------------------------------------------
+static void directory_destroy(memtab_page_directory& directory)
+{
+	for(size_t i = 0; i < directory.capacity; i++)
+		free(directory.slots[i]);
+
+	free(directory.slots);
+	directory.slots = 0;
+	directory.capacity = 0;
+	directory.count = 0;
+}
+
+// ---------------------------------------------------------------------------
+static memtab_page_link** page_slot(const memtab_page_directory& directory,
+									uintptr_t page)
+{
+	memtab_page_leaf* leaf = directory_leaf(directory, page >> LEAF_BITS);
+	if(!leaf)
+		return 0;
+
+	return &leaf->pages[page & (PAGES_PER_LEAF - 1)];
+}
+
+// ---------------------------------------------------------------------------
+static void page_range(const mem_info& info, uintptr_t& first,
+					   uintptr_t& last)
+{
+	uintptr_t start = (uintptr_t)info.address;
+	first = start >> PAGE_SHIFT;
+	last = (start + info.block_size) >> PAGE_SHIFT;
+}
+
+// ---------------------------------------------------------------------------
+static bool page_index_link(memtab_pool& pool,
+							memtab_page_directory& directory,
+							memtab_entry* entry, uintptr_t page)
+{
+	memtab_page_leaf* leaf =
+		directory_add_leaf(directory, page >> LEAF_BITS);
+	if(!leaf)
+		return false;
+
+	memtab_page_link** slot = &leaf->pages[page & (PAGES_PER_LEAF - 1)];
+
+	memtab_page_link* link = (memtab_page_link*)pool.links.allocate();
+	if(!link)
+		return false;
+
+	link->entry = entry;
+	link->next = *slot;
+	*slot = link;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+static void page_index_unlink(memtab_pool& pool,
+							  memtab_page_directory& directory,
+							  memtab_entry* entry, uintptr_t page)
+{
+	memtab_page_link** slot = page_slot(directory, page);
+	if(!slot)
+		return;
+
+	for(memtab_page_link** link = slot; *link; link = &(*link)->next)
+	{
+		if((*link)->entry == entry)
+		{
+			memtab_page_link* dead = *link;
+			*link = dead->next;
+			pool.links.release(dead);
+			break;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+static void page_index_repoint(memtab_page_directory& directory,
+							   uintptr_t page, memtab_entry* from,
+							   memtab_entry* to)
+{
+	memtab_page_link** slot = page_slot(directory, page);
+	if(!slot)
+		return;
+
+	for(memtab_page_link* link = *slot; link; link = link->next)
+	{
+		if(link->entry == from)
+		{
+			link->entry = to;
+			break;
+		}
+	}
+}
+
+// ---------------------------------------------------------------------------
+static bool page_index_add(memtab_pool& pool,
+						   memtab_page_directory& directory,
+						   memtab_entry* entry)
+{
+	uintptr_t first, last;
+	page_range(*entry->info, first, last);
+
+	if(!page_index_link(pool, directory, entry, first))
+		return false;
+
+	if(last != first && !page_index_link(pool, directory, entry, last))
+	{
+		page_index_unlink(pool, directory, entry, first);
+		return false;
+	}
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+static void page_index_remove(memtab_pool& pool,
+							  memtab_page_directory& directory,
+							  memtab_entry* entry)
+{
+	uintptr_t first, last;
+	page_range(*entry->info, first, last);
+
+	page_index_unlink(pool, directory, entry, first);
+
+	if(last != first)
+		page_index_unlink(pool, directory, entry, last);
+}
+
+// ---------------------------------------------------------------------------
+static void page_index_move(memtab_page_directory& directory,
+							const mem_info& info, memtab_entry* from,
+							memtab_entry* to)
+{
+	uintptr_t first, last;
+	page_range(info, first, last);
+
+	page_index_repoint(directory, first, from, to);
+
+	if(last != first)
+		page_index_repoint(directory, last, from, to);
+}
+
+// ---------------------------------------------------------------------------
+static memtab_entry* page_index_find(memtab_entry* root,
+									 const memtab_page_directory& directory,
+									 const void* address)
+{
+	memtab_page_link** slot =
+		page_slot(directory, (uintptr_t)address >> PAGE_SHIFT);
+
+	if(slot)
+	{
+		for(memtab_page_link* link = *slot; link; link = link->next)
+		{
+			memtab_entry* entry = link->entry;
+
+			if(entry->info->address <= address &&
+			   address <= (char*)entry->info->address
+					+ entry->info->block_size)
+			{
+				return entry;
+			}
+		}
+	}
+
+	// The address is not near the start or end of any block in this table,
+	// but it may still be on an interior page of a large one.
+	return memtab_tree_find(root, address);
+}
+
+// ---------------------------------------------------------------------------
+static void page_index_remove_tree(memtab_pool& pool,
+								   memtab_page_directory& directory,
+								   memtab_entry* entry)
+{
+	memtab_cursor cursor;
+
+	for(memtab_cursor_begin(cursor, entry); memtab_cursor_current(cursor);
+		memtab_cursor_advance(cursor))
+	{
+		page_index_remove(pool, directory, memtab_cursor_current(cursor));
+	}
+}
+
+
+// ===========================================================================
+/*
+ * Public interface to the memory table, dispatching to the page index when
+ * it is enabled.
+ */
+
+// ---------------------------------------------------------------------------
+void memtab_set_index_mode(memtab_index_mode mode)
+{
+	index_mode = mode;
+}
+
+// ---------------------------------------------------------------------------
+void memtab_destroy_table(memtab_pool& pool, memtab_entry* entry,
+						  memtab_page_directory& pages)
+{
+	if(index_mode == memtab_index_pages)
+	{
+		page_index_remove_tree(pool, pages, entry);
+		directory_destroy(pages);
+	}
+
+	memtab_tree_destroy(pool, entry);
+}
+
+// ---------------------------------------------------------------------------
+memtab_entry* memtab_find_address(memtab_entry* entry,
+								  const memtab_page_directory& pages,
+								  const void* address)
+{
+	if(index_mode != memtab_index_pages)
+		return memtab_tree_find(entry, address);
+
+	if(!entry)
+		return 0;
+
+	return page_index_find(entry, pages, address);
+}
+
+// ---------------------------------------------------------------------------
+bool memtab_insert_entry(memtab_pool& pool, memtab_entry*& entry,
+						 memtab_page_directory& pages,
+						 memtab_entry* new_entry)
+{
+	if(index_mode == memtab_index_pages &&
+	   !page_index_add(pool, pages, new_entry))
+	{
+		return false;
+	}
+
+	memtab_tree_insert(entry, new_entry);
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+memtab_entry* memtab_remove_entry(memtab_pool& pool, memtab_entry*& entry,
+								  memtab_page_directory& pages,
+								  memtab_entry* target)
+{
+	if(index_mode != memtab_index_pages)
+		return memtab_tree_remove_entry(entry, target);
+
+	page_index_remove(pool, pages, target);
+
+	// If the target node had children, the tree removal swapped its info
+	// with that of an in-order neighbor and unlinked the neighbor's node
+	// instead. The info that now lives in the target node was indexed under
+	// the neighbor, so repoint those links.
+	memtab_entry* removed = memtab_tree_remove_entry(entry, target);
+	if(removed && removed != target)
+		page_index_move(pages, *target->info, removed, target);
+
+	return removed;
+}
+
+// ---------------------------------------------------------------------------
+memtab_entry* memtab_remove_address(memtab_pool& pool, memtab_entry*& entry,
+									memtab_page_directory& pages,
+									const void* address)
+{
+	memtab_entry* found = memtab_find_address(entry, pages, address);
+	if(!found)
+		return 0;
+
+	return memtab_remove_entry(pool, entry, pages, found);
+}
+
+
+// ===========================================================================
+/*
+ * In-order traversal of the memory table. The stack holds the path of
+ * entries whose left subtrees have been entered but which have not yet been
+ * visited themselves.
+ */
+
+// ---------------------------------------------------------------------------
+static void memtab_cursor_descend(memtab_cursor& cursor, memtab_entry* entry)
+{
+	while(entry)
+	{
+		assert(cursor.depth < DEREFEREE_MEMTAB_MAX_DEPTH);
+
+		cursor.stack[cursor.depth++] = entry;
+		entry = entry->_1;
+	}
+}
+
+// ---------------------------------------------------------------------------
+void memtab_cursor_begin(memtab_cursor& cursor, memtab_entry* entry)
+{
+	cursor.depth = 0;
+	memtab_cursor_descend(cursor, entry);
+}
+
+// ---------------------------------------------------------------------------
+memtab_entry* memtab_cursor_current(const memtab_cursor& cursor)
+{
+	return cursor.depth ? cursor.stack[cursor.depth - 1] : 0;
+}
+
+// ---------------------------------------------------------------------------
+void memtab_cursor_advance(memtab_cursor& cursor)
+{
+	if(cursor.depth)
+	{
+		memtab_entry* entry = cursor.stack[--cursor.depth];
+		memtab_cursor_descend(cursor, entry->_2);
+	}
+}
+
 } // namespace Dereferee
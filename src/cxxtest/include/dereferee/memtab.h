@@ -23,6 +23,8 @@
 #include <cassert>
 
 #include <dereferee/types.h>
+#include <dereferee/arena.h>
+#include <dereferee/threads.h>
 
 namespace Dereferee
 {
@@ -34,11 +36,20 @@ namespace Dereferee
  */
 struct mem_info
 {
+	// The fields that are read on every checked pointer operation come
+	// first, so that they share a cache line; mem_info records are allocated
+	// on cache line boundaries (see slab_allocator).
+
 	/**
 	 * The address of the memory allocated.
 	 */
 	const void* address;
 
+	/**
+	 * The size of the block of memory that was allocated.
+	 */
+	size_t block_size;
+
 	/**
 	 * A value from a monotonically increasing set that represents the "time"
 	 * at which is block of memory was allocated during execution.
@@ -46,21 +57,34 @@ struct mem_info
 	memtag_t tag;
 
 	/**
-	 * The size of the block of memory that was allocated.
+	 * A reference count indicating the number of checked pointers that
+	 * currently point to this block of memory.
 	 */
-	size_t block_size;
+	refcount_t ref_count;
 
 	/**
-	 * The size of the cookie allocated before this block, if this block is an
-	 * array of objects with non-trivial destructors.
+	 * The type that was specified in the new/new[] expression that allocated
+	 * this memory, as an identifier in the table of type names (see
+	 * interned_type_name), or 0 if this information is unavailable.
+	 * 
+	 * It is the responsibility of the listener object to convert the name to
+	 * something that is human-readable when printing it, usually by
+	 * demangling it if it is not already in a human-readable form. 
 	 */
-	size_t cookie_size;
+	typename_t type_name;
 
 	/**
-	 * The size of the array that this block represents, if it is an array.
-	 * This is filled at the same time that the cookie size is populated.
+	 * True if this block of memory was allocated with new[]; false if it was
+	 * allocated with new.
 	 */
-	size_t array_size;
+	bool is_array;
+
+	/**
+	 * Initially false, this is set to true once the block has been assigned
+	 * to a checked pointer (that is, once it has moved into a checked
+	 * context).
+	 */
+	bool is_checked;
 
 	/**
 	 * Initially false, this is set to true once the cookie size (and
@@ -69,35 +93,25 @@ struct mem_info
 	bool cookie_size_is_known;
 
 	/**
-	 * A reference count indicating the number of checked pointers that
-	 * currently point to this block of memory.
-	 */
-	refcount_t ref_count;
-	
-	/**
-	 * True if this block of memory was allocated with new[]; false if it was
-	 * allocated with new.
+	 * The size of the cookie allocated before this block, if this block is an
+	 * array of objects with non-trivial destructors.
 	 */
-	bool is_array;
-	
+	unsigned int cookie_size;
+
 	/**
-	 * The implementation-defined string representation of the type that was
-	 * specified in the new/new[] expression that allocated this memory, or
-	 * NULL if this information is unavailable.
-	 * 
-	 * It is the responsibility of the listener object to convert this to
-	 * something that is human-readable when printing it, usually by
-	 * demangling it if it is not already in a human-readable form. 
+	 * The backtrace that indicates the location and context in which this
+	 * memory block was allocated, as an identifier in the table of
+	 * backtraces (see interned_backtrace), or 0 if no backtrace is known.
+	 * Blocks allocated at the same site share the same identifier.
 	 */
-	char* type_name;
-	
+	backtrace_t backtrace;
+
 	/**
-	 * A backtrace (represented by an array of addresses where the last entry
-	 * is NULL) that indicates the location and context in which this memory
-	 * block was allocated.
+	 * The size of the array that this block represents, if it is an array.
+	 * This is filled at the same time that the cookie size is populated.
 	 */
-	void** backtrace;
-	
+	size_t array_size;
+
 	/**
 	 * A listener-specific value that is associated with the memory block.
 	 */
@@ -113,7 +127,130 @@ struct memtab_entry
 {
 	memtab_entry *_1, *_2, *_0;
 	int _3;
-	mem_info info;
+
+	/**
+	 * The information about the block that this entry holds. The mem_info is
+	 * allocated separately from the entry, and rebalancing the table only
+	 * moves this pointer between entries, so the mem_info for a block stays
+	 * at the same address for as long as the block is allocated. This is
+	 * what allows checked pointers to hold on to it and read it without
+	 * locking the table.
+	 */
+	mem_info* info;
+};
+
+
+// ============================================================================
+/**
+ * A link in the list of entries kept for a page by the page index (see
+ * memtab_index_pages).
+ */
+struct memtab_page_link
+{
+	memtab_entry* entry;
+	memtab_page_link* next;
+};
+
+
+// ============================================================================
+/**
+ * The slab allocators from which the entries of a memory table, the
+ * mem_info records that they point to, and the links that index them by
+ * page are allocated.
+ */
+struct memtab_pool
+{
+	slab_allocator entries;
+	slab_allocator infos;
+	slab_allocator links;
+
+	memtab_pool() :
+		entries(sizeof(memtab_entry)), infos(sizeof(mem_info)),
+		links(sizeof(memtab_page_link)) { }
+};
+
+
+// ============================================================================
+/**
+ * The page directory of a memory table, which maps pages of the address
+ * space to the entries whose blocks start or end on them when the page
+ * index is in use (see memtab_index_pages). Each table has a directory of
+ * its own, protected by the same lock as the table.
+ */
+struct memtab_page_leaf;
+
+struct memtab_page_directory
+{
+	memtab_page_leaf** slots;
+	size_t capacity;
+	size_t count;
+
+	memtab_page_directory() : slots(0), capacity(0), count(0) { }
+};
+
+
+// ============================================================================
+/**
+ * A memory table together with its page directory and the lock that
+ * protects both. The memory manager splits its table into several shards by
+ * address so that threads working with unrelated blocks do not contend for
+ * the same lock.
+ */
+struct memtab_shard
+{
+	memtab_entry* root;
+	memtab_page_directory pages;
+	mutex lock;
+
+	memtab_shard() : root(0) { }
+};
+
+
+// ============================================================================
+/**
+ * The greatest height that a memory table can reach. The table is an AVL
+ * tree, whose height is less than 1.45 log2(n + 2) for n entries, so this is
+ * enough for any table that fits in a 64-bit address space.
+ */
+#define DEREFEREE_MEMTAB_MAX_DEPTH 96
+
+/**
+ * Walks the entries of a memory table in order of address, using an
+ * explicit stack rather than recursion. The table must not be modified
+ * while a cursor is walking it.
+ */
+struct memtab_cursor
+{
+	/**
+	 * The entries whose left subtrees are being walked; the entry on top of
+	 * the stack is the current one.
+	 */
+	memtab_entry* stack[DEREFEREE_MEMTAB_MAX_DEPTH];
+
+	/**
+	 * The number of entries on the stack.
+	 */
+	size_t depth;
+};
+
+// ============================================================================
+/**
+ * The strategies that the memory table can use to find the entry whose block
+ * contains an arbitrary address.
+ */
+enum memtab_index_mode
+{
+	/* Search the balanced tree from its root; O(log n) per lookup. This is
+	   the default. */
+	memtab_index_tree = 0,
+
+	/* Consult a two-level page directory that maps the first and last page
+	   of every block to its entry; O(1) per lookup for addresses near either
+	   end of a block, at the cost of some extra bookkeeping on insertion and
+	   removal. Addresses on the interior pages of large blocks are found by
+	   searching the tree, which is still maintained so that entries can be
+	   traversed in address order. */
+	memtab_index_pages
 };
 
 
@@ -124,42 +261,91 @@ struct memtab_entry
 
 // ---------------------------------------------------------------------------
 /**
- * Allocates a new memory table entry and initializes it to default values.
+ * Selects the strategy used to find entries by address. This must be called
+ * before any entries are inserted into a table, since entries that were
+ * inserted under the tree strategy are not known to the page index.
  */
-memtab_entry* memtab_alloc();
+void memtab_set_index_mode(memtab_index_mode mode);
 
 // ---------------------------------------------------------------------------
 /**
- * Releases the memory associated with a memory table entry.
+ * Allocates a new memory table entry and its mem_info from the specified
+ * pool and initializes them to default values. Returns NULL if the system is
+ * out of memory.
  */
-void memtab_free(memtab_entry* entry);
+memtab_entry* memtab_alloc(memtab_pool& pool);
+
+// ---------------------------------------------------------------------------
+/**
+ * Releases the memory associated with a memory table entry, returning the
+ * entry and its mem_info to the pool that they came from. The mem_info's tag
+ * is cleared so that stale references to it can be detected.
+ */
+void memtab_free(memtab_pool& pool, memtab_entry* entry);
 
 // ---------------------------------------------------------------------------
 /**
  * Releases the memory associated with the memory table pointed to by the
- * specified entry.
+ * specified entry and its page directory, returning its entries to the pool
+ * that they came from.
  */
-void memtab_destroy_table(memtab_entry* entry);
+void memtab_destroy_table(memtab_pool& pool, memtab_entry* entry,
+	memtab_page_directory& pages);
 
 // ---------------------------------------------------------------------------
 /**
  * Returns the memory table entry associated with the specified memory address.
  */
-memtab_entry* memtab_find_address(memtab_entry* entry, const void* address);
+memtab_entry* memtab_find_address(memtab_entry* entry,
+	const memtab_page_directory& pages, const void* address);
+
+// ---------------------------------------------------------------------------
+/**
+ * Inserts the specified entry into the memory table, drawing any links that
+ * the page index needs from the specified pool. Returns false, leaving the
+ * table unchanged, if the system is out of memory.
+ */
+bool memtab_insert_entry(memtab_pool& pool, memtab_entry*& entry,
+	memtab_page_directory& pages, memtab_entry* new_entry);
 
 // ---------------------------------------------------------------------------
 /**
- * Inserts the specified entry into the memory table.
+ * Removes the specified entry, previously found in the memory table, from
+ * the table. The node that is unlinked from the table and returned holds
+ * the entry's mem_info, but it may be a different node than the one passed
+ * in, since rebalancing the table moves mem_infos between nodes.
  */
-bool memtab_insert_entry(memtab_entry*& entry, memtab_entry* new_entry);
+memtab_entry* memtab_remove_entry(memtab_pool& pool, memtab_entry*& entry,
+	memtab_page_directory& pages, memtab_entry* target);
 
 // ---------------------------------------------------------------------------
 /**
  * Removes the entry associated with the specified memory address from the
  * memory table.
  */
-memtab_entry* memtab_remove_address(memtab_entry*& entry, const void* address);
+memtab_entry* memtab_remove_address(memtab_pool& pool, memtab_entry*& entry,
+	memtab_page_directory& pages, const void* address);
+
+
+// ---------------------------------------------------------------------------
+/**
+ * Positions the cursor at the entry with the lowest address in the memory
+ * table with the specified root.
+ */
+void memtab_cursor_begin(memtab_cursor& cursor, memtab_entry* entry);
 
+// ---------------------------------------------------------------------------
+/**
+ * Returns the entry at which the cursor is positioned, or NULL if the cursor
+ * has moved past the last entry in the table.
+ */
+memtab_entry* memtab_cursor_current(const memtab_cursor& cursor);
+
+// ---------------------------------------------------------------------------
+/**
+ * Moves the cursor to the entry with the next higher address.
+ */
+void memtab_cursor_advance(memtab_cursor& cursor);
 
 } // namespace Dereferee
 
@@ -79,6 +79,28 @@ extern platform* create_platform(const option* options);
  */
 extern void destroy_platform(platform* platform);
 
+// ---------------------------------------------------------------------------
+/**
+ * Allocates a zero-filled array large enough to hold a backtrace with the
+ * specified number of entries (including the terminating NULL) from the
+ * memory manager's backtrace pool. Platforms should use this in their
+ * get_backtrace method instead of calling malloc directly, since a backtrace
+ * is captured for every allocation made by the program.
+ *
+ * @param entries the number of entries needed
+ * @returns the array, or NULL if the system is out of memory
+ */
+extern void** allocate_backtrace_array(size_t entries);
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns an array obtained from allocate_backtrace_array to the memory
+ * manager's backtrace pool. Passing NULL has no effect.
+ *
+ * @param backtrace the array to free
+ */
+extern void free_backtrace_array(void** backtrace);
+
 
 // ===========================================================================
 /**
@@ -171,6 +193,23 @@ public:
 		void* /* frame */, char* /* function */,
 		char* /* filename */, int* /* line_number */) { return false; }
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Called by the memory manager before it reports a batch of leaks, with
+	 * every distinct frame in their backtraces. Platforms that resolve
+	 * frames slowly can resolve them all here, which is often faster than
+	 * resolving them one at a time in the order the listener asks for them,
+	 * and then answer get_backtrace_frame_info from the results. Whatever is
+	 * done here must not change what get_backtrace_frame_info returns.
+	 *
+	 * The default implementation does nothing.
+	 *
+	 * @param frames the distinct frames, sorted in order of address
+	 * @param count the number of frames
+	 */
+	virtual void prepare_backtrace_frames(void** /* frames */,
+		size_t /* count */) { }
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Converts a mangled C++ type name to a human-readable name. This method
@@ -192,6 +231,19 @@ public:
 	 */
 	virtual void demangle_type_name(char* /* type_name */) { }
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the address at which the executable was loaded, which must be
+	 * subtracted from the addresses in a backtrace to find them in the
+	 * executable's symbol table. This is used by listeners that write out
+	 * raw backtraces to be symbolized later by another tool, instead of
+	 * calling get_backtrace_frame_info.
+	 *
+	 * @returns the load address of the executable, or NULL if it is not
+	 *     known or the executable is not relocated when it is loaded
+	 */
+	virtual void* get_load_address() { return NULL; }
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Saves the current execution context so that it can be restored later.
@@ -0,0 +1,391 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_QUARANTINE_H
+#define DEREFEREE_QUARANTINE_H
+
+#include <cstdlib>
+#include <cassert>
+
+#include <dereferee/types.h>
+#include <dereferee/memtab.h>
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/**
+ * A bounded first-in, first-out queue of memory blocks that have been deleted
+ * but not yet returned to the system. Holding a block here keeps its address
+ * out of circulation, so a dangling pointer to it cannot be confused with a
+ * pointer to a newer block that happens to reuse the address.
+ *
+ * A tombstone (a copy of the block's mem_info) is kept for every quarantined
+ * block and can be found by tag in constant time, so a dead pointer can be
+ * recognized without searching the memory table and diagnostics can describe
+ * where the block was allocated.
+ *
+ * When the queue is full, adding a block evicts the oldest one, which the
+ * caller must then release. A quarantine with a capacity of zero holds
+ * nothing. This class is not intended to be used by clients.
+ */
+class quarantine
+{
+private:
+	/**
+	 * A quarantined block and its tombstone.
+	 */
+	struct record
+	{
+		void* block;
+		mem_info info;
+	};
+
+	/**
+	 * The circular buffer of records, in the order they were added.
+	 */
+	record* _records;
+
+	/**
+	 * The number of records that the buffer can hold.
+	 */
+	size_t _capacity;
+
+	/**
+	 * The index of the oldest record in the buffer.
+	 */
+	size_t _head;
+
+	/**
+	 * The number of records currently in the buffer.
+	 */
+	size_t _count;
+
+	/**
+	 * An open-addressed hash table that maps tags to records. Each slot holds
+	 * the index of a record plus one, or zero if the slot is empty.
+	 */
+	size_t* _slots;
+
+	/**
+	 * The number of slots in the hash table, minus one (the table size is a
+	 * power of two).
+	 */
+	size_t _slot_mask;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the hash table slot at which the search for the specified tag
+	 * begins.
+	 */
+	size_t home_slot(memtag_t tag) const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Adds the record at the specified index to the hash table.
+	 */
+	void hash_insert(size_t index);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Removes the record at the specified index from the hash table.
+	 */
+	void hash_remove(size_t index);
+
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Initializes a new quarantine with a capacity of zero.
+	 */
+	quarantine();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Releases the quarantine's own storage. The blocks that are still held
+	 * must be drained with remove_oldest first.
+	 */
+	~quarantine();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Sets the number of blocks that the quarantine can hold. This can only
+	 * be called while the quarantine is empty.
+	 *
+	 * @param capacity the maximum number of blocks to hold
+	 */
+	void set_capacity(size_t capacity);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the number of blocks that the quarantine can hold.
+	 */
+	size_t capacity() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Adds a deleted block to the quarantine. If the quarantine is full, the
+	 * oldest block is evicted to make room, and the caller becomes
+	 * responsible for releasing it and the resources owned by its tombstone.
+	 *
+	 * @param block the block to hold, as returned by malloc
+	 * @param info the tombstone for the block
+	 * @param evicted_block set to the evicted block, if any
+	 * @param evicted_info set to the tombstone of the evicted block, if any
+	 * @returns true if a block was evicted; otherwise, false
+	 */
+	bool add(void* block, const mem_info& info, void*& evicted_block,
+		mem_info& evicted_info);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Removes the oldest block from the quarantine, making the caller
+	 * responsible for releasing it.
+	 *
+	 * @param block set to the removed block
+	 * @param info set to the tombstone of the removed block
+	 * @returns true if a block was removed; false if the quarantine is empty
+	 */
+	bool remove_oldest(void*& block, mem_info& info);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the tombstone of the quarantined block with the specified tag.
+	 *
+	 * @param tag the tag of the block
+	 * @returns the tombstone, or NULL if no quarantined block has the tag
+	 */
+	const mem_info* find(memtag_t tag) const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Finds the tombstone of the quarantined block that starts at the
+	 * specified address. This is a linear search, intended only for use when
+	 * reporting an error.
+	 *
+	 * @param address the address of the block
+	 * @returns the tombstone, or NULL if no quarantined block has the address
+	 */
+	const mem_info* find_address(const void* address) const;
+
+private:
+	// Quarantines own their memory, so they cannot be copied.
+	quarantine(const quarantine&);
+	quarantine& operator=(const quarantine&);
+};
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::quarantine methods.
+ */
+
+// ---------------------------------------------------------------------------
+inline quarantine::quarantine()
+{
+	_records = NULL;
+	_capacity = 0;
+	_head = 0;
+	_count = 0;
+	_slots = NULL;
+	_slot_mask = 0;
+}
+
+// ---------------------------------------------------------------------------
+inline quarantine::~quarantine()
+{
+	free(_records);
+	free(_slots);
+}
+
+// ---------------------------------------------------------------------------
+inline void quarantine::set_capacity(size_t capacity)
+{
+	assert(_count == 0);
+
+	free(_records);
+	free(_slots);
+
+	_records = NULL;
+	_slots = NULL;
+	_slot_mask = 0;
+	_capacity = 0;
+	_head = 0;
+
+	if(capacity == 0)
+		return;
+
+	// Keep the hash table at most half full so that probe sequences stay
+	// short.
+	size_t slot_count = 2;
+	while(slot_count < 2 * capacity)
+		slot_count *= 2;
+
+	_records = (record*)calloc(capacity, sizeof(record));
+	_slots = (size_t*)calloc(slot_count, sizeof(size_t));
+
+	if(_records && _slots)
+	{
+		_capacity = capacity;
+		_slot_mask = slot_count - 1;
+	}
+	else
+	{
+		free(_records);
+		free(_slots);
+		_records = NULL;
+		_slots = NULL;
+	}
+}
+
+// ---------------------------------------------------------------------------
+inline size_t quarantine::capacity() const
+{
+	return _capacity;
+}
+
+// ---------------------------------------------------------------------------
+inline size_t quarantine::home_slot(memtag_t tag) const
+{
+	return (size_t)(tag * (memtag_t)2654435761UL) & _slot_mask;
+}
+
+// ---------------------------------------------------------------------------
+inline void quarantine::hash_insert(size_t index)
+{
+	size_t slot = home_slot(_records[index].info.tag);
+
+	while(_slots[slot] != 0)
+		slot = (slot + 1) & _slot_mask;
+
+	_slots[slot] = index + 1;
+}
+
+// ---------------------------------------------------------------------------
+inline void quarantine::hash_remove(size_t index)
+{
+	size_t slot = home_slot(_records[index].info.tag);
+
+	while(_slots[slot] != index + 1)
+		slot = (slot + 1) & _slot_mask;
+
+	// Shift later entries in the same probe sequence back into the hole, so
+	// that no search stops early at an empty slot.
+	size_t next = slot;
+
+	for(;;)
+	{
+		next = (next + 1) & _slot_mask;
+
+		if(_slots[next] == 0)
+			break;
+
+		size_t home = home_slot(_records[_slots[next] - 1].info.tag);
+
+		bool movable = (slot <= next)
+			? (home <= slot || home > next)
+			: (home <= slot && home > next);
+
+		if(movable)
+		{
+			_slots[slot] = _slots[next];
+			slot = next;
+		}
+	}
+
+	_slots[slot] = 0;
+}
+
+// ---------------------------------------------------------------------------
+inline bool quarantine::add(void* block, const mem_info& info,
+	void*& evicted_block, mem_info& evicted_info)
+{
+	bool evicted = false;
+
+	if(_count == _capacity)
+	{
+		evicted = remove_oldest(evicted_block, evicted_info);
+	}
+
+	size_t index = (_head + _count) % _capacity;
+
+	_records[index].block = block;
+	_records[index].info = info;
+	hash_insert(index);
+
+	_count++;
+
+	return evicted;
+}
+
+// ---------------------------------------------------------------------------
+inline bool quarantine::remove_oldest(void*& block, mem_info& info)
+{
+	if(_count == 0)
+		return false;
+
+	hash_remove(_head);
+
+	block = _records[_head].block;
+	info = _records[_head].info;
+
+	_head = (_head + 1) % _capacity;
+	_count--;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+inline const mem_info* quarantine::find(memtag_t tag) const
+{
+	if(_count == 0)
+		return NULL;
+
+	size_t slot = home_slot(tag);
+
+	while(_slots[slot] != 0)
+	{
+		const mem_info& info = _records[_slots[slot] - 1].info;
+
+		if(info.tag == tag)
+			return &info;
+
+		slot = (slot + 1) & _slot_mask;
+	}
+
+	return NULL;
+}
+
+// ---------------------------------------------------------------------------
+inline const mem_info* quarantine::find_address(const void* address) const
+{
+	// Search from the newest block, since a block that was deleted twice is
+	// most likely to have been deleted recently.
+	for(size_t i = _count; i > 0; i--)
+	{
+		const mem_info& info = _records[(_head + i - 1) % _capacity].info;
+
+		if(info.address == address)
+			return &info;
+	}
+
+	return NULL;
+}
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_QUARANTINE_H
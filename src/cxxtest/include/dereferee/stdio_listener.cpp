@@ -38,6 +38,10 @@
  * - "max.leaks.to.report": if set, the integer value of this variable
  *   will be used to specify the maximum number of memory leaks that should be
  *   reported at the end of execution.
+ * - "quarantine.size": if set, the integer value of this variable will be
+ *   used to specify the number of deleted blocks of memory that are held out
+ *   of circulation, so that errors involving dangling pointers to them can
+ *   also report where they were allocated. The default is 0 (no quarantine).
  */
 
 // ===========================================================================
@@ -96,7 +100,8 @@ static const char* warning_messages[] =
 {
 	"Memory leak caused by last live pointer to memory block going out of scope",
 	"Memory leak caused by last live pointer to memory block being overwritten",
-	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic"
+	"Memory %s allocated block was corrupted, likely due to invalid array indexing or pointer arithmetic",
+	"Signal-protected regions are nested %d levels deep and there is no memory left to save another backtrace context, so backtraces may be wrong until some of them are left"
 };
 
 // ===========================================================================
@@ -125,6 +130,10 @@ private:
 
 	size_t max_leaks;
 
+	size_t quarantine_blocks;
+
+	void** deleted_backtrace;
+
 	FILE* stream;
 	
 	Dereferee::platform* platform;
@@ -149,6 +158,9 @@ public:
 	// -----------------------------------------------------------------------
 	size_t maximum_leaks_to_report();
 
+	// -----------------------------------------------------------------------
+	size_t quarantine_size();
+
 	// -----------------------------------------------------------------------
 	void begin_report(const Dereferee::usage_stats& stats);
 
@@ -162,6 +174,9 @@ public:
 	// -----------------------------------------------------------------------
 	void end_report();
 	
+	// -----------------------------------------------------------------------
+	void describe_deleted_block(const Dereferee::allocation_info& block);
+
 	// -----------------------------------------------------------------------
 	void error(Dereferee::error_code code, va_list args);
 
@@ -179,6 +194,8 @@ stdio_listener::stdio_listener(const Dereferee::option* options,
 	stream = stdout;
 	prefix_string = NULL;
 	max_leaks = UINT_MAX;
+	quarantine_blocks = 0;
+	deleted_backtrace = NULL;
 
 	while(options->key != NULL)
 	{
@@ -199,6 +216,10 @@ stdio_listener::stdio_listener(const Dereferee::option* options,
 		{
 			max_leaks = atoi(options->value);
 		}
+		else if(strcmp(options->key, "quarantine.size") == 0)
+		{
+			quarantine_blocks = atoi(options->value);
+		}
 		
 		options++;
 	}
@@ -217,6 +238,12 @@ size_t stdio_listener::maximum_leaks_to_report()
 	return max_leaks;
 }
 
+// ------------------------------------------------------------------
+size_t stdio_listener::quarantine_size()
+{
+	return quarantine_blocks;
+}
+
 // ------------------------------------------------------------------
 void stdio_listener::begin_report(const Dereferee::usage_stats& stats)
 {
@@ -301,6 +328,15 @@ void stdio_listener::end_report()
 				   usage_stats->calls_to_array_delete_null());
 }
 
+// ------------------------------------------------------------------
+void stdio_listener::describe_deleted_block(
+	const Dereferee::allocation_info& block)
+{
+	// The backtrace belongs to the quarantined block, so it is still valid
+	// when error() is called immediately afterward.
+	deleted_backtrace = block.backtrace();
+}
+
 // ------------------------------------------------------------------
 void stdio_listener::error(Dereferee::error_code code, va_list args)
 {
@@ -310,8 +346,15 @@ void stdio_listener::error(Dereferee::error_code code, va_list args)
 
 	void** bt = platform->get_backtrace(NULL, NULL);
 	print_backtrace(bt, "error in");
-	prefix_printf("\n");
 	platform->free_backtrace(bt);
+
+	if(deleted_backtrace)
+	{
+		print_backtrace(deleted_backtrace, "allocated in");
+		deleted_backtrace = NULL;
+	}
+
+	prefix_printf("\n");
 }
 
 // ------------------------------------------------------------------
@@ -0,0 +1,399 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_THREADS_H
+#define DEREFEREE_THREADS_H
+
+#include <cstdlib>
+
+#include <dereferee/config.h>
+#include <dereferee/types.h>
+
+#ifdef DEREFEREE_THREAD_SAFE
+#	include <atomic>
+#	include <mutex>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#	endif
+#endif
+
+/**
+ * GCC's __atomic builtins are used in place of std::atomic where they are
+ * available, since they are expanded inline even when optimization is turned
+ * off, which is how submissions are usually compiled.
+ */
+#if defined(DEREFEREE_THREAD_SAFE) && defined(__GNUC__)
+#	define DEREFEREE_GCC_ATOMICS
+#endif
+
+/**
+ * The helpers below are called on every allocation and on most pointer
+ * operations, so they are inlined even when optimization is turned off.
+ */
+#ifdef __GNUC__
+#	define DEREFEREE_FORCE_INLINE inline __attribute__((always_inline))
+#else
+#	define DEREFEREE_FORCE_INLINE inline
+#endif
+
+/**
+ * The size of a cache line, used to keep data that is written by different
+ * threads from sharing a line.
+ */
+#define DEREFEREE_CACHE_LINE_SIZE 64
+
+namespace Dereferee
+{
+
+/**
+ * Declares a variable with thread storage duration when the memory manager
+ * is thread-safe; otherwise, a single copy is shared by the whole program.
+ */
+#ifdef DEREFEREE_THREAD_SAFE
+#	define DEREFEREE_THREAD_LOCAL thread_local
+#else
+#	define DEREFEREE_THREAD_LOCAL
+#endif
+
+
+// ===========================================================================
+/**
+ * A non-recursive lock that protects the memory manager's internal tables.
+ * When DEREFEREE_THREAD_SAFE is not defined, locking and unlocking do
+ * nothing. This class is not intended to be used by clients.
+ *
+ * A mutex can be used as an object with static storage duration even before
+ * static initializers have run, so it is safe to use from the global new and
+ * delete operators.
+ */
+class mutex
+{
+private:
+#ifdef DEREFEREE_THREAD_SAFE
+	std::mutex _mutex;
+#endif
+
+public:
+	// -----------------------------------------------------------------------
+#ifdef DEREFEREE_THREAD_SAFE
+	constexpr mutex() : _mutex() { }
+#else
+	mutex() { }
+#endif
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Acquires the lock, waiting for it if another thread holds it.
+	 */
+	void lock();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Releases the lock.
+	 */
+	void unlock();
+
+private:
+	// Locks cannot be copied.
+	mutex(const mutex&);
+	mutex& operator=(const mutex&);
+};
+
+
+// ===========================================================================
+/**
+ * Holds a lock for the lifetime of the object.
+ */
+class scoped_lock
+{
+private:
+	mutex& _mutex;
+
+public:
+	explicit scoped_lock(mutex& m) : _mutex(m) { _mutex.lock(); }
+	~scoped_lock() { _mutex.unlock(); }
+
+private:
+	scoped_lock(const scoped_lock&);
+	scoped_lock& operator=(const scoped_lock&);
+};
+
+
+// ===========================================================================
+/**
+ * A size_t counter that can be updated from several threads at once without
+ * a lock. Updates are atomic but are not ordered with respect to other
+ * memory operations.
+ */
+class atomic_counter
+{
+private:
+#if defined(DEREFEREE_THREAD_SAFE) && !defined(DEREFEREE_GCC_ATOMICS)
+	std::atomic<size_t> _value;
+#else
+	size_t _value;
+#endif
+
+public:
+	// -----------------------------------------------------------------------
+	atomic_counter() : _value(0) { }
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Gets the current value of the counter.
+	 */
+	size_t value() const;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Adds the specified amount to the counter.
+	 *
+	 * @returns the new value of the counter
+	 */
+	size_t add(size_t amount);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Subtracts the specified amount from the counter.
+	 *
+	 * @returns the new value of the counter
+	 */
+	size_t subtract(size_t amount);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Sets the counter to the specified value if it is larger than the
+	 * counter's current value.
+	 */
+	void raise_to(size_t candidate);
+
+private:
+	atomic_counter(const atomic_counter&);
+	atomic_counter& operator=(const atomic_counter&);
+};
+
+
+// ===========================================================================
+/*
+ * Pointer loads and stores, used to publish an object that was fully
+ * constructed by one thread so that another thread sees it completely.
+ */
+
+// ---------------------------------------------------------------------------
+template <typename T>
+DEREFEREE_FORCE_INLINE T* atomic_load_pointer(T* const& pointer)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_load_n(&pointer, __ATOMIC_ACQUIRE);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	// Visual C++ gives volatile reads acquire semantics.
+	return *(T* const volatile*)&pointer;
+#else
+	return pointer;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+template <typename T>
+DEREFEREE_FORCE_INLINE void atomic_store_pointer(T*& pointer, T* value)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	__atomic_store_n(&pointer, value, __ATOMIC_RELEASE);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	// Visual C++ gives volatile writes release semantics.
+	*(T* volatile*)&pointer = value;
+#else
+	pointer = value;
+#endif
+}
+
+
+// ===========================================================================
+/*
+ * Tag loads and stores. A block's tag is what tells a checked pointer that a
+ * mem_info it held on to still describes its block, so the tag is stored
+ * with release semantics once the rest of the mem_info has been filled in,
+ * and again when the block is freed. A reader loads the tag, reads the
+ * fields that it guards, and then reloads the tag; since tags are never
+ * reused, the fields are only trusted if both loads return the same tag.
+ */
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE memtag_t atomic_load_memtag(const memtag_t& tag)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_load_n(&tag, __ATOMIC_ACQUIRE);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return *(const volatile memtag_t*)&tag;
+#else
+	return tag;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+/**
+ * Loads a tag again after reading the fields that it guards, making sure
+ * that those reads are not moved after this load.
+ */
+DEREFEREE_FORCE_INLINE memtag_t atomic_reload_memtag(const memtag_t& tag)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&tag, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return *(const volatile memtag_t*)&tag;
+#else
+	return tag;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE void atomic_store_memtag(memtag_t& tag, memtag_t value)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	__atomic_store_n(&tag, value, __ATOMIC_RELEASE);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	*(volatile memtag_t*)&tag = value;
+#else
+	tag = value;
+#endif
+}
+
+
+// ===========================================================================
+/*
+ * Reference count updates. Checked pointers update the reference count in a
+ * block's mem_info directly, without locking the memory table, so these
+ * must be atomic. Each returns the new value of the count.
+ */
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE refcount_t atomic_increment(refcount_t& count)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_add_fetch(&count, 1, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return (refcount_t)_InterlockedIncrement((volatile long*)&count);
+#else
+	return ++count;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE refcount_t atomic_decrement(refcount_t& count)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_sub_fetch(&count, 1, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return (refcount_t)_InterlockedDecrement((volatile long*)&count);
+#else
+	return --count;
+#endif
+}
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::mutex methods.
+ */
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE void mutex::lock()
+{
+#ifdef DEREFEREE_THREAD_SAFE
+	_mutex.lock();
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE void mutex::unlock()
+{
+#ifdef DEREFEREE_THREAD_SAFE
+	_mutex.unlock();
+#endif
+}
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::atomic_counter methods.
+ */
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE size_t atomic_counter::value() const
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_load_n(&_value, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return _value.load(std::memory_order_relaxed);
+#else
+	return _value;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE size_t atomic_counter::add(size_t amount)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_add_fetch(&_value, amount, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return _value.fetch_add(amount, std::memory_order_relaxed) + amount;
+#else
+	return _value += amount;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE size_t atomic_counter::subtract(size_t amount)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	return __atomic_sub_fetch(&_value, amount, __ATOMIC_RELAXED);
+#elif defined(DEREFEREE_THREAD_SAFE)
+	return _value.fetch_sub(amount, std::memory_order_relaxed) - amount;
+#else
+	return _value -= amount;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+DEREFEREE_FORCE_INLINE void atomic_counter::raise_to(size_t candidate)
+{
+#if defined(DEREFEREE_GCC_ATOMICS)
+	size_t current = __atomic_load_n(&_value, __ATOMIC_RELAXED);
+
+	while(current < candidate && !__atomic_compare_exchange_n(&_value,
+		&current, candidate, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+	}
+#elif defined(DEREFEREE_THREAD_SAFE)
+	size_t current = _value.load(std::memory_order_relaxed);
+
+	while(current < candidate && !_value.compare_exchange_weak(
+		current, candidate, std::memory_order_relaxed))
+	{
+	}
+#else
+	if(_value < candidate)
+		_value = candidate;
+#endif
+}
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_THREADS_H
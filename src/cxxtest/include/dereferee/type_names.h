@@ -0,0 +1,269 @@
+/*
+ *	This file is part of Dereferee, the diagnostic checked pointer library.
+ *
+ *	Dereferee is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	Dereferee is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with Dereferee; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEREFEREE_TYPE_NAMES_H
+#define DEREFEREE_TYPE_NAMES_H
+
+#include <cstdlib>
+#include <cstring>
+
+#include <dereferee/types.h>
+#include <dereferee/threads.h>
+
+namespace Dereferee
+{
+
+// ===========================================================================
+/**
+ * The number of names stored in each chunk of a type_name_table.
+ */
+#define DEREFEREE_TYPE_NAMES_PER_CHUNK 256
+
+/**
+ * The largest number of chunks in a type_name_table, which limits the
+ * number of distinct type names that can be interned.
+ */
+#define DEREFEREE_TYPE_NAME_CHUNKS 1024
+
+
+// ===========================================================================
+/**
+ * A table that stores a single copy of each distinct type name and assigns
+ * it a small integer identifier, so that the memory table can record the
+ * type of every block without a separate copy of the name for each one.
+ *
+ * Names are never removed. They are stored in chunks that never move once
+ * allocated, so a name can be looked up by its identifier without a lock.
+ * Interning a name takes the table's lock.
+ *
+ * The table needs no initialization beyond the zero-filling given to objects
+ * with static storage duration, and has no destructor, so the shared
+ * instance is ready for use before static initializers run and is still
+ * usable while the final leak report is being made. This class is not
+ * intended to be used by clients.
+ */
+class type_name_table
+{
+private:
+	/**
+	 * The chunks of names, in the order that they were interned. The name
+	 * with identifier n is entry (n - 1) % DEREFEREE_TYPE_NAMES_PER_CHUNK of
+	 * chunk (n - 1) / DEREFEREE_TYPE_NAMES_PER_CHUNK.
+	 */
+	char** _chunks[DEREFEREE_TYPE_NAME_CHUNKS];
+
+	/**
+	 * The number of names in the table.
+	 */
+	typename_t _count;
+
+	/**
+	 * An open-addressed hash table that maps names to their identifiers.
+	 * Each slot holds the identifier of a name, or zero if the slot is
+	 * empty.
+	 */
+	typename_t* _slots;
+
+	/**
+	 * The number of slots in the hash table (always zero or a power of two).
+	 */
+	size_t _slot_count;
+
+	/**
+	 * Protects the table while a name is being interned.
+	 */
+	mutex _lock;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns a hash code for the specified name.
+	 */
+	static size_t hash(const char* name);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Doubles the size of the hash table, or creates it if it does not yet
+	 * exist.
+	 *
+	 * @returns true if the table was grown; false if the system is out of
+	 *     memory
+	 */
+	bool grow_slots();
+
+public:
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the identifier of the specified name, adding a copy of the
+	 * name to the table if it is not already there.
+	 *
+	 * @param name the type name to intern
+	 * @returns the identifier of the name, or 0 if the name could not be
+	 *     added to the table
+	 */
+	typename_t intern(const char* name);
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the name with the specified identifier.
+	 *
+	 * @param id an identifier returned by intern
+	 * @returns the name, or NULL if the identifier is 0
+	 */
+	const char* name(typename_t id) const;
+};
+
+
+// ===========================================================================
+/*
+ * Implementation of the Dereferee::type_name_table methods.
+ */
+
+// ---------------------------------------------------------------------------
+inline size_t type_name_table::hash(const char* name)
+{
+	// FNV-1a.
+	size_t code = (size_t)2166136261U;
+
+	for(; *name; name++)
+		code = (code ^ (unsigned char)*name) * (size_t)16777619U;
+
+	return code;
+}
+
+// ---------------------------------------------------------------------------
+inline bool type_name_table::grow_slots()
+{
+	size_t new_count = _slot_count ? _slot_count * 2 : 64;
+	typename_t* new_slots =
+		(typename_t*)calloc(new_count, sizeof(typename_t));
+
+	if(!new_slots)
+		return false;
+
+	for(size_t i = 0; i < _slot_count; i++)
+	{
+		if(_slots[i] != 0)
+		{
+			size_t j = hash(name(_slots[i])) & (new_count - 1);
+			while(new_slots[j] != 0)
+				j = (j + 1) & (new_count - 1);
+
+			new_slots[j] = _slots[i];
+		}
+	}
+
+	free(_slots);
+	_slots = new_slots;
+	_slot_count = new_count;
+
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+inline typename_t type_name_table::intern(const char* name_to_find)
+{
+	if(!name_to_find)
+		return 0;
+
+	scoped_lock lock(_lock);
+
+	size_t code = hash(name_to_find);
+
+	if(_slot_count)
+	{
+		size_t i = code & (_slot_count - 1);
+
+		while(_slots[i] != 0)
+		{
+			if(strcmp(name(_slots[i]), name_to_find) == 0)
+				return _slots[i];
+
+			i = (i + 1) & (_slot_count - 1);
+		}
+	}
+
+	// Keep the hash table at most half full so that probe sequences stay
+	// short.
+	if(2 * ((size_t)_count + 1) > _slot_count && !grow_slots())
+		return 0;
+
+	size_t chunk = _count / DEREFEREE_TYPE_NAMES_PER_CHUNK;
+	if(chunk >= DEREFEREE_TYPE_NAME_CHUNKS)
+		return 0;
+
+	if(!_chunks[chunk])
+	{
+		_chunks[chunk] =
+			(char**)calloc(DEREFEREE_TYPE_NAMES_PER_CHUNK, sizeof(char*));
+
+		if(!_chunks[chunk])
+			return 0;
+	}
+
+	size_t length = strlen(name_to_find) + 1;
+	char* copy = (char*)malloc(length);
+	if(!copy)
+		return 0;
+
+	memcpy(copy, name_to_find, length);
+	_chunks[chunk][_count % DEREFEREE_TYPE_NAMES_PER_CHUNK] = copy;
+
+	typename_t id = ++_count;
+
+	size_t i = code & (_slot_count - 1);
+	while(_slots[i] != 0)
+		i = (i + 1) & (_slot_count - 1);
+
+	_slots[i] = id;
+
+	return id;
+}
+
+// ---------------------------------------------------------------------------
+inline const char* type_name_table::name(typename_t id) const
+{
+	if(id == 0)
+		return NULL;
+
+	return _chunks[(id - 1) / DEREFEREE_TYPE_NAMES_PER_CHUNK]
+		[(id - 1) % DEREFEREE_TYPE_NAMES_PER_CHUNK];
+}
+
+
+// ===========================================================================
+/*
+ * Access to the table of type names shared by the whole program.
+ */
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns the identifier of the specified type name in the table of type
+ * names shared by the whole program, adding the name if necessary.
+ */
+typename_t intern_type_name(const char* name);
+
+// ---------------------------------------------------------------------------
+/**
+ * Returns the type name with the specified identifier from the table of
+ * type names shared by the whole program, or NULL if the identifier is 0.
+ */
+const char* interned_type_name(typename_t id);
+
+} // namespace Dereferee
+
+#endif // DEREFEREE_TYPE_NAMES_H
@@ -31,8 +31,22 @@ typedef unsigned long memtag_t;
 
 /**
  * The type used to keep track of the reference count for a block of memory.
+ * This is 32 bits wide on every platform, which keeps the mem_info structure
+ * within a single cache line.
  */
-typedef unsigned long refcount_t;
+typedef unsigned int refcount_t;
+
+/**
+ * The identifier of a type name that has been interned in the table of type
+ * names (see type_names.h). Zero means that no type name is known.
+ */
+typedef unsigned int typename_t;
+
+/**
+ * The identifier of a backtrace that has been interned in the table of
+ * backtraces (see backtrace_table.h). Zero means that no backtrace is known.
+ */
+typedef unsigned int backtrace_t;
 
 /**
  * The default tag used for uninitialized pointers.
@@ -20,47 +20,48 @@ namespace Dereferee
 {
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::checked_ptr()
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr()
 {
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::checked_ptr(pointer_type ptr) :
+template <typename T, typename checks>
+checked_ptr<T, checks>::checked_ptr(pointer_type ptr) :
 	pointer(ptr)
 {
 }
 
 // ------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const dynamic_cast_helper<U*>& rhs) :
+checked_ptr<T, checks>::checked_ptr(const dynamic_cast_helper<U*>& rhs) :
 	pointer((pointer_type)rhs)
 {
 }
 
 // -----------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>::checked_ptr(const dynamic_cast_helper<U* const>& rhs) :
+checked_ptr<T, checks>::checked_ptr(const dynamic_cast_helper<U* const>& rhs) :
 	pointer((pointer_type)rhs)
 {
 }
 
 // -----------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(const dynamic_cast_helper<U*>& rhs)
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
+	const dynamic_cast_helper<U*>& rhs)
 {
 	pointer = (pointer_type)rhs;
 	return *this;
 }
 
 // -----------------------------------------------------------------------
-template <typename T>
+template <typename T, typename checks>
 template <typename U>
-checked_ptr<T>& checked_ptr<T>::operator=(
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator=(
 	const dynamic_cast_helper<U* const>& rhs)
 {
 	pointer = (pointer_type)rhs;
@@ -68,156 +69,160 @@ checked_ptr<T>& checked_ptr<T>::operator=(
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator==(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator==(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer == rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator!=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator!=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return !(lhs == rhs);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator<(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator<(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer < rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator<=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator<=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer <= rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator>(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator>(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer > rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-bool operator>=(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+bool operator>=(const checked_ptr<U, UC>& lhs, const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer >= rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator++()
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator++()
 {
 	pointer++;
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T> checked_ptr<T>::operator++(int)
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::operator++(int)
 {
-	checked_ptr<T> retval = *this;
+	checked_ptr<T, checks> retval = *this;
 	++(*this);
 	return retval;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator--()
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator--()
 {
 	pointer--;
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T> checked_ptr<T>::operator--(int)
+template <typename T, typename checks>
+checked_ptr<T, checks> checked_ptr<T, checks>::operator--(int)
 {
-	checked_ptr<T> retval = *this;
+	checked_ptr<T, checks> retval = *this;
 	--(*this);
 	return retval;	
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator+(const checked_ptr<U>& ptr, ptrdiff_t delta)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator+(const checked_ptr<U, UC>& ptr, ptrdiff_t delta)
 {
-	return checked_ptr<U>(ptr.pointer + delta);
+	return checked_ptr<U, UC>(ptr.pointer + delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator+(ptrdiff_t delta, const checked_ptr<U>& ptr)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator+(ptrdiff_t delta, const checked_ptr<U, UC>& ptr)
 {
 	return (ptr + delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U>
-checked_ptr<U> operator-(const checked_ptr<U>& ptr, ptrdiff_t delta)
+template <typename U, typename UC>
+checked_ptr<U, UC> operator-(const checked_ptr<U, UC>& ptr, ptrdiff_t delta)
 {
 	return (ptr + -delta);
 }
 
 // ------------------------------------------------------------------
-template <typename U, typename V>
-ptrdiff_t operator-(const checked_ptr<U>& lhs, const checked_ptr<V>& rhs)
+template <typename U, typename UC, typename V, typename VC>
+ptrdiff_t operator-(const checked_ptr<U, UC>& lhs,
+	const checked_ptr<V, VC>& rhs)
 {
 	return (lhs.pointer - rhs.pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator+=(ptrdiff_t delta)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator+=(ptrdiff_t delta)
 {
 	pointer += delta;
 	return *this;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>& checked_ptr<T>::operator-=(ptrdiff_t delta)
+template <typename T, typename checks>
+checked_ptr<T, checks>& checked_ptr<T, checks>::operator-=(ptrdiff_t delta)
 {
 	return (*this += -delta);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::reference_type checked_ptr<T>::operator*()
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::reference_type
+checked_ptr<T, checks>::operator*()
 {
 	return *pointer;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::pointer_type checked_ptr<T>::operator->()
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::pointer_type
+checked_ptr<T, checks>::operator->()
 {
 	return pointer;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-checked_ptr<T>::operator pointer_type() const
+template <typename T, typename checks>
+checked_ptr<T, checks>::operator pointer_type() const
 {
 	return pointer;
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-template <typename U>
-checked_ptr<T>::operator checked_ptr<U>()
+template <typename T, typename checks>
+template <typename U, typename UC>
+checked_ptr<T, checks>::operator checked_ptr<U, UC>()
 {
-	return checked_ptr<U>(pointer);
+	return checked_ptr<U, UC>(pointer);
 }
 
 // ------------------------------------------------------------------
-template <typename T>
-typename checked_ptr<T>::reference_type checked_ptr<T>::operator[](int index)
+template <typename T, typename checks>
+typename checked_ptr<T, checks>::reference_type
+checked_ptr<T, checks>::operator[](int index)
 {
 	return pointer[index];
 }
@@ -22,6 +22,7 @@
 
 #include <cstdlib>
 #include <dereferee/pointer_traits.h>
+#include <dereferee/check_level.h>
 
 
 namespace Dereferee
@@ -41,9 +42,11 @@ template <typename U> class const_cast_helper;
  * checks for a release or production build. For most compilers it should not
  * be necessary; if variadic macros are supported, the checked(T*) syntax will
  * resolve directly to T* in those cases. This class is provided as a
- * compromise for environments that do not support this macro.
+ * compromise for environments that do not support this macro. The policy
+ * parameter is accepted so that the same declarations compile, but it is
+ * ignored.
  */
-template <typename T>
+template <typename T, typename checks = default_checks>
 class checked_ptr
 {
 private:
@@ -111,7 +114,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const dynamic_cast_helper<U*>& rhs);
+	checked_ptr<T, checks>& operator=(const dynamic_cast_helper<U*>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -123,7 +126,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const dynamic_cast_helper<U* const>& rhs);
+	checked_ptr<T, checks>& operator=(const dynamic_cast_helper<U* const>& rhs);
 #endif
 
 #ifndef DEREFEREE_NO_CONST_CAST
@@ -159,7 +162,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const const_cast_helper<U*>& rhs);
+	checked_ptr<T, checks>& operator=(const const_cast_helper<U*>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -171,7 +174,7 @@ public:
 	 * @returns a reference to this pointer
 	 */
 	template <typename U>
-	checked_ptr<T>& operator=(const const_cast_helper<U* const>& rhs);
+	checked_ptr<T, checks>& operator=(const const_cast_helper<U* const>& rhs);
 #endif
 
 	// -----------------------------------------------------------------------
@@ -184,9 +187,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator==(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator==(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -198,9 +201,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator!=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator!=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -212,9 +215,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator<(const checked_ptr<U>& lhs,
-						  const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator<(const checked_ptr<U, UC>& lhs,
+						  const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -226,9 +229,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator<=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator<=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -240,9 +243,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator>(const checked_ptr<U>& lhs,
-						  const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator>(const checked_ptr<U, UC>& lhs,
+						  const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -254,9 +257,9 @@ public:
 	 * @returns true if the pointers point to the same address; otherwise,
 	 *     false.
 	 */
-	template <typename U, typename V>
-	friend bool operator>=(const checked_ptr<U>& lhs,
-						   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend bool operator>=(const checked_ptr<U, UC>& lhs,
+						   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -264,7 +267,7 @@ public:
 	 *
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator++();
+	checked_ptr<T, checks>& operator++();
 
 	// -----------------------------------------------------------------------
 	/**
@@ -273,7 +276,7 @@ public:
 	 * @returns a pointer that points to the original value before this
 	 *     pointer was incremented
 	 */
-	checked_ptr<T> operator++(int);
+	checked_ptr<T, checks> operator++(int);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -281,7 +284,7 @@ public:
 	 *
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator--();
+	checked_ptr<T, checks>& operator--();
 	
 	// -----------------------------------------------------------------------
 	/**
@@ -290,7 +293,7 @@ public:
 	 * @returns a pointer that points to the original value before this
 	 *     pointer was decremented
 	 */
-	checked_ptr<T> operator--(int);
+	checked_ptr<T, checks> operator--(int);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -301,8 +304,8 @@ public:
 	 * @param delta the number of elements to advance
 	 * @returns a pointer that points to memory delta elements after ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator+(const checked_ptr<U>& ptr,
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator+(const checked_ptr<U, UC>& ptr,
 									ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
@@ -314,9 +317,9 @@ public:
 	 * @param ptr the pointer to advance from
 	 * @returns a pointer that points to memory delta elements after ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator+(ptrdiff_t delta,
-									const checked_ptr<U>& ptr);
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator+(ptrdiff_t delta,
+									const checked_ptr<U, UC>& ptr);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -326,8 +329,8 @@ public:
 	 * @param delta the number of elements to move back
 	 * @returns a pointer that points to memory delta elements before ptr
 	 */
-	template <typename U>
-	friend checked_ptr<U> operator-(const checked_ptr<U>& ptr,
+	template <typename U, typename UC>
+	friend checked_ptr<U, UC> operator-(const checked_ptr<U, UC>& ptr,
 									ptrdiff_t delta);
 	
 	// -----------------------------------------------------------------------
@@ -339,9 +342,9 @@ public:
 	 * @returns a ptrdiff_t value that indicates the distance between the two
 	 *     pointers
 	 */
-	template <typename U, typename V>
-	friend ptrdiff_t operator-(const checked_ptr<U>& lhs,
-							   const checked_ptr<V>& rhs);
+	template <typename U, typename UC, typename V, typename VC>
+	friend ptrdiff_t operator-(const checked_ptr<U, UC>& lhs,
+							   const checked_ptr<V, VC>& rhs);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -350,7 +353,7 @@ public:
 	 * @param delta the number of elements to advance
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator+=(ptrdiff_t delta);
+	checked_ptr<T, checks>& operator+=(ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -359,7 +362,7 @@ public:
 	 * @param delta the number of elements to move back
 	 * @returns this pointer
 	 */
-	checked_ptr<T>& operator-=(ptrdiff_t delta);
+	checked_ptr<T, checks>& operator-=(ptrdiff_t delta);
 
 	// -----------------------------------------------------------------------
 	/**
@@ -396,8 +399,8 @@ public:
 	 * @returns a checked pointer of type checked(U*) that points to the same
 	 *     address as this pointer.
 	 */
-	template <typename U>
-	operator checked_ptr<U>();
+	template <typename U, typename UC>
+	operator checked_ptr<U, UC>();
 
 	// -----------------------------------------------------------------------
 	/**
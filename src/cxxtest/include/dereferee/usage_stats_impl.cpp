@@ -26,15 +26,32 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <dereferee/usage_stats_impl.h>
 
 namespace Dereferee
 {
 
+// ===========================================================================
+/*
+ * The counter block of the current thread. The owner is recorded alongside
+ * the block so that a thread never uses a block belonging to some other
+ * usage_stats_impl object.
+ */
+struct counters_slot
+{
+	const usage_stats_impl* owner;
+	void* block;
+};
+
+static DEREFEREE_THREAD_LOCAL counters_slot thread_slot = { NULL, NULL };
+
+
 // ===========================================================================
 
 usage_stats_impl::usage_stats_impl()
 {
+	_leaks = 0;
 	_total_bytes_allocated = 0;
 	_current_bytes_allocated = 0;
 	_maximum_bytes_in_use = 0;
@@ -44,6 +61,112 @@ usage_stats_impl::usage_stats_impl()
 	_calls_to_array_delete = 0;
 	_calls_to_delete_null = 0;
 	_calls_to_array_delete_null = 0;
+	_arena_bytes_reserved = 0;
+	_arena_slabs_reserved = 0;
+	_arena_objects_allocated = 0;
+
+	memset(&_shared_counters, 0, sizeof(_shared_counters));
+	_thread_counters = NULL;
+}
+
+// ---------------------------------------------------------------------------
+usage_stats_impl::~usage_stats_impl()
+{
+	thread_counters* block = _thread_counters;
+
+	while(block != NULL)
+	{
+		thread_counters* next = block->next;
+		free(block->storage);
+		block = next;
+	}
+
+	if(thread_slot.owner == this)
+	{
+		thread_slot.owner = NULL;
+		thread_slot.block = NULL;
+	}
+}
+
+// ---------------------------------------------------------------------------
+usage_stats_impl::thread_counters* usage_stats_impl::counters()
+{
+	if(thread_slot.owner == this)
+		return (thread_counters*)thread_slot.block;
+
+	// Round the block up to a whole number of cache lines and leave room to
+	// align its start to a cache line boundary.
+	const size_t line = DEREFEREE_CACHE_LINE_SIZE;
+	size_t size = (sizeof(thread_counters) + line - 1) & ~(line - 1);
+
+	void* storage = malloc(size + line - 1);
+	thread_counters* block;
+
+	if(storage != NULL)
+	{
+		block = (thread_counters*)
+			(((size_t)storage + line - 1) & ~(line - 1));
+
+		memset(block, 0, sizeof(thread_counters));
+		block->storage = storage;
+
+		scoped_lock lock(_thread_counters_lock);
+		block->next = _thread_counters;
+		_thread_counters = block;
+	}
+	else
+	{
+		// Threads that share this block may lose updates to one another, but
+		// the statistics are only used for reporting.
+		block = &_shared_counters;
+	}
+
+	thread_slot.owner = this;
+	thread_slot.block = block;
+	return block;
+}
+
+// ---------------------------------------------------------------------------
+void usage_stats_impl::merge_thread_counters()
+{
+	scoped_lock lock(_thread_counters_lock);
+
+	ptrdiff_t current = _shared_counters.current_bytes_allocated;
+	_total_bytes_allocated = _shared_counters.total_bytes_allocated;
+	_maximum_bytes_in_use = _shared_counters.maximum_bytes_in_use;
+	_calls_to_new = _shared_counters.calls_to_new;
+	_calls_to_delete = _shared_counters.calls_to_delete;
+	_calls_to_array_new = _shared_counters.calls_to_array_new;
+	_calls_to_array_delete = _shared_counters.calls_to_array_delete;
+	_calls_to_delete_null = _shared_counters.calls_to_delete_null;
+	_calls_to_array_delete_null = _shared_counters.calls_to_array_delete_null;
+
+	for(thread_counters* block = _thread_counters; block != NULL;
+		block = block->next)
+	{
+		current += block->current_bytes_allocated;
+		_total_bytes_allocated += block->total_bytes_allocated;
+		_maximum_bytes_in_use += block->maximum_bytes_in_use;
+		_calls_to_new += block->calls_to_new;
+		_calls_to_delete += block->calls_to_delete;
+		_calls_to_array_new += block->calls_to_array_new;
+		_calls_to_array_delete += block->calls_to_array_delete;
+		_calls_to_delete_null += block->calls_to_delete_null;
+		_calls_to_array_delete_null += block->calls_to_array_delete_null;
+	}
+
+	// A thread's bytes in use can go negative when it frees memory that
+	// another thread allocated, but the sum over all threads cannot.
+	_current_bytes_allocated = (current > 0) ? (size_t)current : 0;
+
+	// The per-thread peaks may have been reached at different times, so
+	// their sum can only overestimate the true peak; it can never be more
+	// than the number of bytes allocated in all.
+	if(_maximum_bytes_in_use > _total_bytes_allocated)
+		_maximum_bytes_in_use = _total_bytes_allocated;
+
+	if(_maximum_bytes_in_use < _current_bytes_allocated)
+		_maximum_bytes_in_use = _current_bytes_allocated;
 }
 
 // ---------------------------------------------------------------------------
@@ -100,45 +223,81 @@ size_t usage_stats_impl::calls_to_array_delete_null() const
 	return _calls_to_array_delete_null;
 }
 
+// ---------------------------------------------------------------------------
+size_t usage_stats_impl::arena_bytes_reserved() const
+{
+	return _arena_bytes_reserved;
+}
+
+// ---------------------------------------------------------------------------
+size_t usage_stats_impl::arena_slabs_reserved() const
+{
+	return _arena_slabs_reserved;
+}
+
+// ---------------------------------------------------------------------------
+size_t usage_stats_impl::arena_objects_allocated() const
+{
+	return _arena_objects_allocated;
+}
+
 // ---------------------------------------------------------------------------
 void usage_stats_impl::set_leaks(size_t leaks)
 {
 	_leaks = leaks;
 }
 
+// ---------------------------------------------------------------------------
+void usage_stats_impl::set_arena_usage(size_t bytes_reserved,
+	size_t slabs_reserved, size_t objects_allocated)
+{
+	_arena_bytes_reserved = bytes_reserved;
+	_arena_slabs_reserved = slabs_reserved;
+	_arena_objects_allocated = objects_allocated;
+}
+
 // ---------------------------------------------------------------------------
 void usage_stats_impl::record_allocation(size_t size, bool is_array)
 {
+	thread_counters* block = counters();
+
 	if(is_array)
-		_calls_to_array_new++;
+		block->calls_to_array_new++;
 	else
-		_calls_to_new++;
+		block->calls_to_new++;
 
-	_current_bytes_allocated += size;
-	_total_bytes_allocated += size;
-	
-	if(_current_bytes_allocated > _maximum_bytes_in_use)
-		_maximum_bytes_in_use = _current_bytes_allocated;
+	block->total_bytes_allocated += size;
+	block->current_bytes_allocated += size;
+
+	if(block->current_bytes_allocated > 0 &&
+		(size_t)block->current_bytes_allocated > block->maximum_bytes_in_use)
+	{
+		block->maximum_bytes_in_use = block->current_bytes_allocated;
+	}
 }
 
 // ---------------------------------------------------------------------------
 void usage_stats_impl::record_deallocation(size_t size, bool is_array)
 {
-	_current_bytes_allocated -= size;
+	thread_counters* block = counters();
+
+	block->current_bytes_allocated -= size;
 	
 	if(is_array)
-		_calls_to_array_delete++;
+		block->calls_to_array_delete++;
 	else
-		_calls_to_delete++;
+		block->calls_to_delete++;
 }
 
 // ---------------------------------------------------------------------------
 void usage_stats_impl::record_null_deallocation(bool is_array)
 {
+	thread_counters* block = counters();
+
 	if(is_array)
-		_calls_to_array_delete_null++;
+		block->calls_to_array_delete_null++;
 	else
-		_calls_to_delete_null++;
+		block->calls_to_delete_null++;
 }
 
 
@@ -20,7 +20,9 @@
 #define DEREFEREE_USAGE_STATS_IMPL_H
 
 #include <cstdarg>
+#include <cstddef>
 #include <dereferee/listener.h>
+#include <dereferee/threads.h>
 
 namespace Dereferee
 {
@@ -30,6 +32,18 @@ namespace Dereferee
  * A concrete implementation of the Dereferee::usage_stats interface, used by
  * the memory manager to report memory usage statistics to the listener. This
  * class is not intended to be used by clients.
+ *
+ * Each thread counts its own allocations and deallocations in a block of
+ * counters that no other thread writes to, so recording them needs neither a
+ * lock nor an atomic operation. The blocks are merged into the totals below
+ * by merge_thread_counters when the report is built.
+ *
+ * The maximum number of bytes in use is tracked exactly for each thread, as
+ * the peak of the bytes that thread allocated minus the bytes it freed. The
+ * global maximum is merged as the sum of the per-thread peaks, limited to the
+ * total number of bytes allocated. This is never less than the true peak, and
+ * it is exact when all of the memory is allocated by one thread (other
+ * threads that only free memory have a peak of zero).
  */
 class usage_stats_impl : public usage_stats
 {
@@ -39,6 +53,9 @@ private:
 	 */
 	unsigned int _leaks;
 	
+	// The totals from here to _calls_to_array_delete_null are filled in by
+	// merge_thread_counters.
+
 	/**
 	 * The total number of bytes allocated throughout the execution of the
 	 * program.
@@ -89,13 +106,87 @@ private:
 	 * null argument.
 	 */
 	size_t _calls_to_array_delete_null;
+
+	/**
+	 * The number of bytes reserved by the memory manager for bookkeeping.
+	 */
+	size_t _arena_bytes_reserved;
+
+	/**
+	 * The number of slabs reserved by the memory manager for bookkeeping.
+	 */
+	size_t _arena_slabs_reserved;
+
+	/**
+	 * The number of bookkeeping objects allocated from those slabs.
+	 */
+	size_t _arena_objects_allocated;
 	
+	/**
+	 * The counters kept by a single thread. Each block is allocated on a
+	 * cache line boundary and padded to a whole number of cache lines, so
+	 * that threads updating their own blocks do not contend for a line.
+	 */
+	struct thread_counters
+	{
+		size_t total_bytes_allocated;
+		ptrdiff_t current_bytes_allocated;
+		size_t maximum_bytes_in_use;
+		size_t calls_to_new;
+		size_t calls_to_delete;
+		size_t calls_to_array_new;
+		size_t calls_to_array_delete;
+		size_t calls_to_delete_null;
+		size_t calls_to_array_delete_null;
+
+		/**
+		 * The next block in the list of all blocks.
+		 */
+		thread_counters* next;
+
+		/**
+		 * The address returned by malloc for this block, before it was
+		 * aligned.
+		 */
+		void* storage;
+	};
+
+	/**
+	 * The list of the counter blocks of every thread that has allocated or
+	 * freed memory. Blocks outlive their threads, so that their counts are
+	 * still included in the report.
+	 */
+	thread_counters* _thread_counters;
+
+	/**
+	 * Protects the list of counter blocks.
+	 */
+	mutex _thread_counters_lock;
+
+	/**
+	 * The block used by threads for which a block could not be allocated.
+	 */
+	thread_counters _shared_counters;
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Returns the counter block of the current thread, creating it first if
+	 * necessary.
+	 */
+	thread_counters* counters();
+
 public:
 	// -----------------------------------------------------------------------
 	/**
 	 * Initializes a new usage_stats_impl object.
 	 */
 	usage_stats_impl();
+
+	// -----------------------------------------------------------------------
+	/**
+	 * Releases the counter blocks of every thread.
+	 */
+	~usage_stats_impl();
 	
 	// -----------------------------------------------------------------------
 	size_t leaks() const;
@@ -123,7 +214,24 @@ public:
 
 	// -----------------------------------------------------------------------
 	size_t calls_to_array_delete_null() const;
+
+	// -----------------------------------------------------------------------
+	size_t arena_bytes_reserved() const;
+
+	// -----------------------------------------------------------------------
+	size_t arena_slabs_reserved() const;
+
+	// -----------------------------------------------------------------------
+	size_t arena_objects_allocated() const;
 	
+	// -----------------------------------------------------------------------
+	/**
+	 * Merges the counters kept by each thread into the totals reported by
+	 * this object. This should be called just before the statistics are
+	 * reported, when other threads are no longer allocating memory.
+	 */
+	void merge_thread_counters();
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Sets the number of leaks that were recorded during execution.
@@ -132,6 +240,18 @@ public:
 	 */
 	void set_leaks(size_t leaks);
 
+	// -----------------------------------------------------------------------
+	/**
+	 * Sets the usage of the memory manager's bookkeeping arenas at the time
+	 * of the report.
+	 *
+	 * @param bytes_reserved the number of bytes reserved in slabs
+	 * @param slabs_reserved the number of slabs reserved
+	 * @param objects_allocated the number of objects allocated from them
+	 */
+	void set_arena_usage(size_t bytes_reserved, size_t slabs_reserved,
+		size_t objects_allocated);
+
 	// -----------------------------------------------------------------------
 	/**
 	 * Updates the usage statistics based on an allocation made by the user.